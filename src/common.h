@@ -1,6 +1,20 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
 #include <cmath>
+#include <compare>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <iostream>
+#include <numeric>
+#include <optional>
 #include "doctest.h"
 
 using std::vector, std::tuple;
@@ -44,6 +58,195 @@ T hexagonal(int n) {
     return n * (2*n - 1);
 }
 
+template <int S, typename T = uint64_t>
+constexpr T polygonal(const T n) {
+    static_assert(S >= 3);
+    return ((S - 2) * n * n - (S - 4) * n) / 2;
+}
+
+// Number of S-gonal numbers P(1), P(2), ... that are <= x
+template <int S>
+uint64_t polygonal_count(const uint64_t x) {
+    // (S-2) n^2 - (S-4) n - 2x = 0
+    // n = ((S-4) + sqrt((S-4)^2 + 8 (S-2) x)) / (2 (S-2))
+    const double a = S - 2;
+    const double b = S - 4;
+    auto n = static_cast<uint64_t>((b + std::sqrt(b * b + 8 * a * static_cast<double>(x))) / (2 * a));
+    while (n > 0 && polygonal<S>(n) > x) {
+        n--;
+    }
+    while (polygonal<S>(n + 1) <= x) {
+        n++;
+    }
+    return n;
+}
+
+// Calls f(lo, hi) on contiguous chunks of [begin, end), one chunk per thread
+template <typename F>
+void parallel_for(const uint64_t begin, const uint64_t end, F f, unsigned threads = 0) {
+    if (end <= begin) {
+        return;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const uint64_t n = end - begin;
+    threads = static_cast<unsigned>(std::min<uint64_t>(threads, n));
+    if (threads == 1) {
+        f(begin, end);
+        return;
+    }
+
+    const uint64_t chunk = (n + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (uint64_t lo = begin; lo < end; lo += chunk) {
+        const uint64_t hi = std::min(end, lo + chunk);
+        pool.emplace_back([&f, lo, hi] { f(lo, hi); });
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+}
+
+// Membership index over the S-gonal numbers <= limit.
+// Small limits use a bitmap that only stores the residues mod M that S-gonal numbers can actually hit,
+// so x maps to bit (x / M) * R + rank[x % M]. Once sqrt(limit) 64-bit values take less room than that,
+// the numbers are stored sorted in Eytzinger (BFS) order instead, which keeps the top of the search tree hot in cache.
+template <int S>
+class FigurateIndex {
+public:
+    explicit FigurateIndex(const uint64_t limit, unsigned threads = 0) : limit_(limit), count_(polygonal_count<S>(limit)) {
+        choose_residues();
+        const uint64_t bitmap_bits = (limit_ / modulus_ + 1) * residues_.size();
+        sparse_ = count_ * 64 < bitmap_bits;
+        if (sparse_) {
+            build_sorted(threads);
+        } else {
+            build_bitmap(threads);
+        }
+    }
+
+    bool contains(const uint64_t x) const {
+        if (x == 0 || x > limit_) {
+            return false;
+        }
+        if (sparse_) {
+            uint64_t k = 1;
+            while (k <= count_) {
+                k = 2 * k + (tree_[k] < x);
+            }
+            k >>= __builtin_ffsll(~k);
+            return k != 0 && tree_[k] == x;
+        }
+        const int r = rank_[x % modulus_];
+        if (r < 0) {
+            return false;
+        }
+        const uint64_t bit = (x / modulus_) * residues_.size() + r;
+        return (bits_[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    // Calls f(x) for every S-gonal x in [lo, hi], in increasing order
+    template <typename F>
+    void for_each(const uint64_t lo, const uint64_t hi, F f) const {
+        const uint64_t top = std::min(hi, limit_);
+        if (lo > top) {
+            return;
+        }
+        for (uint64_t n = polygonal_count<S>(lo == 0 ? 0 : lo - 1) + 1; n <= count_; n++) {
+            const uint64_t x = polygonal<S>(n);
+            if (x > top) {
+                break;
+            }
+            f(x);
+        }
+    }
+
+    uint64_t limit() const { return limit_; }
+    uint64_t size() const { return count_; }
+    bool sparse() const { return sparse_; }
+    size_t memory_bytes() const { return bits_.size() * 8 + tree_.size() * 8 + rank_.size() * sizeof(int16_t); }
+
+private:
+    // P(n + 2M) = P(n) (mod M), so the residues hit mod M are those of n < 2M.
+    // Pick the M that wastes the fewest bits.
+    void choose_residues() {
+        double best_density = 2;
+        for (uint64_t M = 1; M <= 128; M++) {
+            std::vector<bool> hit(M, false);
+            for (uint64_t n = 0; n < 2 * M; n++) {
+                hit[polygonal<S>(n) % M] = true;
+            }
+            const auto R = std::count(hit.begin(), hit.end(), true);
+            const double density = static_cast<double>(R) / M;
+            if (density < best_density) {
+                best_density = density;
+                modulus_ = M;
+                rank_.assign(M, -1);
+                residues_.clear();
+                for (uint64_t r = 0; r < M; r++) {
+                    if (hit[r]) {
+                        rank_[r] = residues_.size();
+                        residues_.push_back(r);
+                    }
+                }
+            }
+        }
+    }
+
+    void build_bitmap(unsigned threads) {
+        const uint64_t R = residues_.size();
+        const uint64_t blocks = limit_ / modulus_ + 1;
+        bits_.assign((blocks * R + 63) / 64, 0);
+
+        // Chunks of 64 residue blocks start on a word boundary, so threads never share a word
+        const uint64_t chunk_span = 64 * modulus_;
+        parallel_for(0, limit_ / chunk_span + 1, [&](uint64_t c_lo, uint64_t c_hi) {
+            const uint64_t x_lo = c_lo * chunk_span;
+            const uint64_t x_hi = std::min(limit_, c_hi * chunk_span - 1);
+            for (uint64_t n = polygonal_count<S>(x_lo == 0 ? 0 : x_lo - 1) + 1; n <= count_; n++) {
+                const uint64_t x = polygonal<S>(n);
+                if (x > x_hi) {
+                    break;
+                }
+                const uint64_t bit = (x / modulus_) * R + rank_[x % modulus_];
+                bits_[bit / 64] |= uint64_t{1} << (bit % 64);
+            }
+        }, threads);
+    }
+
+    void build_sorted(unsigned threads) {
+        std::vector<uint64_t> sorted(count_);
+        parallel_for(0, count_, [&](uint64_t lo, uint64_t hi) {
+            for (uint64_t i = lo; i < hi; i++) {
+                sorted[i] = polygonal<S>(i + 1);
+            }
+        }, threads);
+
+        tree_.assign(count_ + 1, 0);
+        uint64_t i = 0;
+        fill_tree(sorted, i, 1);
+    }
+
+    // In-order walk of the implicit tree hands out the sorted values
+    void fill_tree(const std::vector<uint64_t> &sorted, uint64_t &i, const uint64_t k) {
+        if (k <= count_) {
+            fill_tree(sorted, i, 2 * k);
+            tree_[k] = sorted[i++];
+            fill_tree(sorted, i, 2 * k + 1);
+        }
+    }
+
+    uint64_t limit_;
+    uint64_t count_;
+    bool sparse_ = false;
+    uint64_t modulus_ = 1;
+    std::vector<int16_t> rank_;
+    std::vector<uint64_t> residues_;
+    std::vector<uint64_t> bits_;
+    std::vector<uint64_t> tree_;
+};
+
 bool is_prime(int n) {
     if (n == 1) {
         return false;
@@ -61,41 +264,2164 @@ bool is_prime(int n) {
             if (n % f == 0) {
                 return false;
             }
-            if (n % (f+2) == 0) {
-                return false;
+            if (n % (f+2) == 0) {
+                return false;
+            }
+            f += 6;
+        }
+        return true;
+    }
+}
+
+std::vector<bool> prime_sieve(int n) {
+
+    std::vector<bool> sieve(n+1, true);
+
+    // Sieve remaining numbers
+    for (int i = 2; i*i <= n; i+=1) {
+        if (sieve[i]) {
+            for (int j = i*i; j <= n; j +=i) {
+                sieve[j] = false;
+            }
+        }
+    }
+
+    return sieve;
+}
+
+std::vector<int> primes(int n) {
+    auto sieve = prime_sieve(n);
+    std::vector<int> _primes{2};
+    for (int i = 3; i <= n; ++ i) {
+        if (sieve[i]) {
+            _primes.push_back(i);
+        }
+    }
+    return _primes;
+}
+
+// Signature contribution of each two-digit chunk 00..99
+constexpr std::array<uint64_t, 100> DIGIT_PAIR_SIGNATURE = [] {
+    std::array<uint64_t, 100> table{};
+    for (int i = 0; i < 100; i++) {
+        table[i] = (uint64_t{1} << (4 * (i / 10))) + (uint64_t{1} << (4 * (i % 10)));
+    }
+    return table;
+}();
+
+// Whether every digit of n appears at most 15 times, so its count fits in 4 bits. Only numbers
+// of 16 or more digits can fail, e.g. 1111111111111111.
+constexpr bool digit_signature_fits(uint64_t n) {
+    if (n < 1'000'000'000'000'000ull) {
+        return true;
+    }
+    std::array<int, 10> counts{};
+    for (; n != 0; n /= 10) {
+        if (++counts[n % 10] > 15) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Digit histogram of n packed into one word: bits 4d..4d+3 count the digit d. Two numbers are
+// permutations of each other's digits exactly when their signatures match, as long as no digit
+// appears 16 or more times (see digit_signature_fits). Digits are taken two at a time from a
+// table, so there is one division by a constant per pair of digits.
+constexpr uint64_t digit_signature(uint64_t n) {
+    assert(digit_signature_fits(n));
+    uint64_t key = 0;
+    while (n >= 100) {
+        key += DIGIT_PAIR_SIGNATURE[n % 100];
+        n /= 100;
+    }
+    if (n >= 10) {
+        return key + DIGIT_PAIR_SIGNATURE[n];
+    }
+    return n == 0 ? key : key + (uint64_t{1} << (4 * n));
+}
+
+// Number of decimal digits counted in a signature
+constexpr int signature_length(const uint64_t key) {
+    int length = 0;
+    for (int d = 0; d < 10; d++) {
+        length += (key >> (4 * d)) & 15;
+    }
+    return length;
+}
+
+// Calls f(n) for every distinct number whose digits are the multiset in signature, once each and
+// in increasing order. Forms with a leading zero are skipped by starting from the smallest
+// arrangement with a nonzero first digit: every later arrangement in lexicographic order keeps it.
+template <typename F>
+void for_each_digit_permutation(const uint64_t signature, F f) {
+    std::array<uint8_t, 20> digits{};
+    int length = 0;
+    for (uint8_t d = 0; d < 10; d++) {
+        for (uint64_t c = (signature >> (4 * d)) & 15; c > 0; c--) {
+            digits[length++] = d;
+        }
+    }
+    const auto first = digits.begin();
+    const auto last = digits.begin() + length;
+    const auto lead = std::find_if(first, last, [](const uint8_t d) { return d != 0; });
+    if (lead == last) {
+        return;
+    }
+    std::iter_swap(first, lead);
+    do {
+        uint64_t n = 0;
+        for (auto it = first; it != last; ++it) {
+            n = 10 * n + *it;
+        }
+        f(n);
+    } while (std::next_permutation(first, last));
+}
+
+// Fixed-size bitset packed into 64-bit words, bit i lives in word i / 64
+struct Bitmap {
+    uint64_t size = 0;
+    std::vector<uint64_t> words;
+
+    Bitmap() = default;
+    explicit Bitmap(const uint64_t n, const bool value = false) : size(n), words((n + 63) / 64, value ? ~uint64_t{0} : 0) {
+        trim();
+    }
+
+    bool test(const uint64_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+    void set(const uint64_t i) { words[i / 64] |= uint64_t{1} << (i % 64); }
+    void reset(const uint64_t i) { words[i / 64] &= ~(uint64_t{1} << (i % 64)); }
+
+    // words [w_lo, w_hi) of (*this |= other << shift)
+    void or_shifted(const Bitmap &other, const uint64_t shift, const uint64_t w_lo, const uint64_t w_hi) {
+        const uint64_t ws = shift / 64;
+        const unsigned bs = shift % 64;
+        const uint64_t begin = std::max(w_lo, ws);
+        if (bs == 0) {
+            const uint64_t end = std::min<uint64_t>(w_hi, std::min(words.size(), other.words.size() + ws));
+            for (uint64_t i = begin; i < end; i++) {
+                words[i] |= other.words[i - ws];
+            }
+        } else {
+            // one word past the source for the bits carried out of its top word
+            const uint64_t end = std::min<uint64_t>(w_hi, std::min(words.size(), other.words.size() + ws + 1));
+            for (uint64_t i = begin; i < end; i++) {
+                const uint64_t j = i - ws;
+                const uint64_t carry = j > 0 ? other.words[j - 1] >> (64 - bs) : 0;
+                const uint64_t low = j < other.words.size() ? other.words[j] << bs : 0;
+                words[i] |= low | carry;
+            }
+        }
+    }
+
+    void or_shifted(const Bitmap &other, const uint64_t shift) {
+        or_shifted(other, shift, 0, words.size());
+        trim();
+    }
+
+    // clear the unused bits past size in the last word
+    void trim() {
+        if (size % 64 != 0) {
+            words.back() &= (uint64_t{1} << (size % 64)) - 1;
+        }
+    }
+};
+
+// Bit i is set iff i is prime, for 0 <= i <= n
+Bitmap prime_bitmap(const uint64_t n) {
+    Bitmap sieve(n + 1, true);
+    sieve.reset(0);
+    if (n >= 1) {
+        sieve.reset(1);
+    }
+    for (uint64_t i = 4; i <= n; i += 2) {
+        sieve.reset(i);
+    }
+    for (uint64_t i = 3; i * i <= n; i += 2) {
+        if (sieve.test(i)) {
+            for (uint64_t j = i * i; j <= n; j += 2 * i) {
+                sieve.reset(j);
+            }
+        }
+    }
+    return sieve;
+}
+
+// Bit i is set iff lo + i is prime, for lo <= lo + i < hi.
+// base_primes must hold every prime up to sqrt(hi).
+Bitmap segmented_prime_bitmap(const uint64_t lo, const uint64_t hi, const std::vector<uint64_t> &base_primes) {
+    Bitmap segment(hi - lo, true);
+    for (uint64_t i = lo; i < std::min<uint64_t>(hi, 2); i++) {
+        segment.reset(i - lo);
+    }
+    for (const uint64_t p : base_primes) {
+        if (p * p >= hi) {
+            break;
+        }
+        uint64_t start = std::max(p * p, (lo + p - 1) / p * p);
+        for (uint64_t j = start; j < hi; j += p) {
+            segment.reset(j - lo);
+        }
+    }
+    return segment;
+}
+
+// Packed BCD: decimal digit i of n (counting from the units) in bits 4i..4i+3, for n < 10^16.
+// Digit tests and replacements are then masks and shifts on the whole number at once.
+constexpr uint64_t NIBBLE_LOW_BITS = 0x1111'1111'1111'1111ull;
+
+constexpr std::array<uint8_t, 100> BCD_PAIR = [] {
+    std::array<uint8_t, 100> table{};
+    for (int i = 0; i < 100; i++) {
+        table[i] = static_cast<uint8_t>((i / 10) << 4 | (i % 10));
+    }
+    return table;
+}();
+
+constexpr uint64_t to_bcd(uint64_t n) {
+    uint64_t bcd = 0;
+    for (int shift = 0; n > 0; shift += 8) {
+        bcd |= uint64_t{BCD_PAIR[n % 100]} << shift;
+        n /= 100;
+    }
+    return bcd;
+}
+
+constexpr uint64_t from_bcd(const uint64_t bcd) {
+    uint64_t n = 0;
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        n = 10 * n + ((bcd >> shift) & 15);
+    }
+    return n;
+}
+
+// Number of digits, from the highest nonzero nibble
+constexpr int bcd_digit_count(const uint64_t bcd) {
+    return (std::bit_width(bcd) + 3) / 4;
+}
+
+// The low bit of every nibble among the lowest digits that holds d. A nibble is zero after
+// xor with d exactly where the digit was d, and or-ing each nibble into its low bit finds them.
+constexpr uint64_t bcd_digit_positions(const uint64_t bcd, const int digits, const unsigned d) {
+    uint64_t x = bcd ^ (d * NIBBLE_LOW_BITS);
+    x |= x >> 1;
+    x |= x >> 2;
+    const uint64_t in_range = digits >= 16 ? NIBBLE_LOW_BITS : NIBBLE_LOW_BITS & ((uint64_t{1} << (4 * digits)) - 1);
+    return ~x & in_range;
+}
+
+// How many times d occurs among the lowest digits
+constexpr int bcd_digit_frequency(const uint64_t bcd, const int digits, const unsigned d) {
+    return std::popcount(bcd_digit_positions(bcd, digits, d));
+}
+
+// Sets the digits at positions (as from bcd_digit_positions) to d
+constexpr uint64_t bcd_replace(const uint64_t bcd, const uint64_t positions, const unsigned d) {
+    return (bcd & ~(positions * 15)) | (positions * d);
+}
+
+// digit_signature of the number, read straight off its nibbles
+constexpr uint64_t bcd_signature(const uint64_t bcd) {
+    uint64_t key = 0;
+    for (int i = bcd_digit_count(bcd) - 1; i >= 0; i--) {
+        key += uint64_t{1} << (4 * ((bcd >> (4 * i)) & 15));
+    }
+    return key;
+}
+
+// The primes in [lo, hi), found segment by segment in parallel, optionally with each prime's
+// packed BCD digits in a parallel array (hi <= 10^16).
+class PrimeTable {
+public:
+    PrimeTable(const uint64_t lo, const uint64_t hi, const bool with_bcd = false, unsigned threads = 0) {
+        const auto root_sieve = prime_bitmap(static_cast<uint64_t>(std::sqrt(static_cast<double>(hi))) + 1);
+        std::vector<uint64_t> base;
+        for (uint64_t i = 2; i < root_sieve.size; i++) {
+            if (root_sieve.test(i)) {
+                base.push_back(i);
+            }
+        }
+
+        constexpr uint64_t segment = uint64_t{1} << 20;
+        const uint64_t segments = hi > lo ? (hi - lo + segment - 1) / segment : 0;
+        std::vector<std::vector<uint64_t>> found(segments);
+        parallel_for(0, segments, [&](uint64_t s_lo, uint64_t s_hi) {
+            for (uint64_t s = s_lo; s < s_hi; s++) {
+                const uint64_t a = lo + s * segment;
+                const uint64_t b = std::min(hi, a + segment);
+                const Bitmap bits = segmented_prime_bitmap(a, b, base);
+                for (uint64_t i = 0; i < b - a; i++) {
+                    if (bits.test(i)) {
+                        found[s].push_back(a + i);
+                    }
+                }
+            }
+        }, threads);
+        for (const auto &f : found) {
+            primes_.insert(primes_.end(), f.begin(), f.end());
+        }
+
+        if (with_bcd) {
+            assert(hi <= 10'000'000'000'000'000ull);
+            bcd_.resize(primes_.size());
+            parallel_for(0, primes_.size(), [&](uint64_t i_lo, uint64_t i_hi) {
+                for (uint64_t i = i_lo; i < i_hi; i++) {
+                    bcd_[i] = to_bcd(primes_[i]);
+                }
+            }, threads);
+        }
+    }
+
+    size_t size() const { return primes_.size(); }
+    bool has_bcd() const { return !bcd_.empty() || primes_.empty(); }
+    std::span<const uint64_t> primes() const { return primes_; }
+    std::span<const uint64_t> bcd() const { return bcd_; }
+
+private:
+    std::vector<uint64_t> primes_;
+    std::vector<uint64_t> bcd_;
+};
+
+uint64_t mul_mod64(const uint64_t a, const uint64_t b, const uint64_t n) {
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(a) * b % n);
+}
+
+// a + b and a - b mod n for a, b < n, without wrapping even when n is above 2^63
+uint64_t add_mod64(const uint64_t a, const uint64_t b, const uint64_t n) {
+    return a >= n - b ? a - (n - b) : a + b;
+}
+
+uint64_t sub_mod64(const uint64_t a, const uint64_t b, const uint64_t n) {
+    return a >= b ? a - b : a + (n - b);
+}
+
+uint64_t pow_mod64(uint64_t a, uint64_t b, const uint64_t n) {
+    uint64_t acc = 1 % n;
+    a %= n;
+    while (b > 0) {
+        if (b & 1) {
+            acc = mul_mod64(acc, a, n);
+        }
+        a = mul_mod64(a, a, n);
+        b >>= 1;
+    }
+    return acc;
+}
+
+// Deterministic Miller-Rabin, the first twelve primes as bases cover every 64-bit n
+bool is_prime_u64(const uint64_t n) {
+    if (n < 2) {
+        return false;
+    }
+    for (const uint64_t p : {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}) {
+        if (n % p == 0) {
+            return n == p;
+        }
+    }
+    uint64_t d = n - 1;
+    int s = 0;
+    while (d % 2 == 0) {
+        d /= 2;
+        s++;
+    }
+    for (const uint64_t a : {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}) {
+        uint64_t x = pow_mod64(a, d, n);
+        if (x == 1 || x == n - 1) {
+            continue;
+        }
+        bool composite = true;
+        for (int r = 1; r < s; r++) {
+            x = mul_mod64(x, x, n);
+            if (x == n - 1) {
+                composite = false;
+                break;
+            }
+        }
+        if (composite) {
+            return false;
+        }
+    }
+    return true;
+}
+
+using u128 = unsigned __int128;
+
+// Barrett reduction for any 64-bit modulus n: q = floor(x mu / 2^128) with mu = floor((2^128 - 1) / n)
+// underestimates x / n by at most a couple, so x - q n only needs a few subtractions.
+struct Barrett64 {
+    uint64_t n;
+    u128 mu;
+
+    constexpr explicit Barrett64(const uint64_t modulus) : n(modulus), mu(~u128{0} / modulus) {}
+
+    // x mod n
+    constexpr uint64_t reduce(const u128 x) const {
+        const uint64_t x0 = static_cast<uint64_t>(x);
+        const uint64_t x1 = static_cast<uint64_t>(x >> 64);
+        const uint64_t m0 = static_cast<uint64_t>(mu);
+        const uint64_t m1 = static_cast<uint64_t>(mu >> 64);
+
+        // high 128 bits of the 256-bit product x * mu
+        const u128 x0m0 = u128{x0} * m0;
+        const u128 x0m1 = u128{x0} * m1;
+        const u128 x1m0 = u128{x1} * m0;
+        const u128 mid = (x0m0 >> 64) + static_cast<uint64_t>(x0m1) + static_cast<uint64_t>(x1m0);
+        const u128 q = u128{x1} * m1 + (x0m1 >> 64) + (x1m0 >> 64) + (mid >> 64);
+
+        u128 r = x - q * n;
+        while (r >= n) {
+            r -= n;
+        }
+        return static_cast<uint64_t>(r);
+    }
+
+    constexpr uint64_t mul(const uint64_t a, const uint64_t b) const {
+        return reduce(u128{a} * b);
+    }
+
+    constexpr uint64_t pow(uint64_t a, uint64_t e) const {
+        uint64_t acc = reduce(1);
+        a = reduce(a);
+        while (e > 0) {
+            if (e & 1) {
+                acc = mul(acc, a);
+            }
+            a = mul(a, a);
+            e >>= 1;
+        }
+        return acc;
+    }
+};
+
+// Montgomery form for odd moduli: x is stored as x 2^64 mod n, and a product is reduced
+// with two multiplications and no division. Works for any odd n < 2^64.
+struct Montgomery64 {
+    uint64_t n;
+    uint64_t n_inv;     // n^-1 mod 2^64
+    uint64_t r2;        // 2^128 mod n
+
+    constexpr explicit Montgomery64(const uint64_t modulus) : n(modulus), n_inv(modulus), r2(0) {
+        // Newton's iteration doubles the number of correct low bits, n n = 1 (mod 8) to start
+        for (int i = 0; i < 5; i++) {
+            n_inv *= 2 - n * n_inv;
+        }
+        const uint64_t r1 = (0 - n) % n;
+        r2 = static_cast<uint64_t>(u128{r1} * r1 % n);
+    }
+
+    // t 2^-64 mod n, for t < n 2^64
+    constexpr uint64_t reduce(const u128 t) const {
+        const uint64_t m = static_cast<uint64_t>(t) * n_inv;
+        const uint64_t t_hi = static_cast<uint64_t>(t >> 64);
+        const uint64_t mn_hi = static_cast<uint64_t>((u128{m} * n) >> 64);
+        return t_hi >= mn_hi ? t_hi - mn_hi : t_hi - mn_hi + n;
+    }
+
+    constexpr uint64_t to_montgomery(const uint64_t a) const { return reduce(u128{a % n} * r2); }
+    constexpr uint64_t from_montgomery(const uint64_t a) const { return reduce(a); }
+    constexpr uint64_t mul(const uint64_t a, const uint64_t b) const { return reduce(u128{a} * b); }
+
+    // a^e mod n for ordinary (not Montgomery form) a
+    constexpr uint64_t pow(const uint64_t a, uint64_t e) const {
+        uint64_t acc = to_montgomery(1);
+        uint64_t base = to_montgomery(a);
+        while (e > 0) {
+            if (e & 1) {
+                acc = mul(acc, base);
+            }
+            base = mul(base, base);
+            e >>= 1;
+        }
+        return from_montgomery(acc);
+    }
+};
+
+// a^-1 mod m by the extended Euclidean algorithm, 0 when gcd(a, m) != 1
+constexpr uint64_t inverse_mod(const uint64_t a, const uint64_t m) {
+    int64_t t = 0;
+    int64_t new_t = 1;
+    uint64_t r = m;
+    uint64_t new_r = a % m;
+    while (new_r != 0) {
+        const uint64_t q = r / new_r;
+        const int64_t next_t = t - static_cast<int64_t>(q) * new_t;
+        t = new_t;
+        new_t = next_t;
+        const uint64_t next_r = r - q * new_r;
+        r = new_r;
+        new_r = next_r;
+    }
+    if (r != 1) {
+        return 0;
+    }
+    return t < 0 ? static_cast<uint64_t>(t + static_cast<int64_t>(m)) : static_cast<uint64_t>(t) % m;
+}
+
+// Residue mod M. Everything is constexpr for a compile-time modulus; ModInt<0> takes its modulus
+// at runtime from ModInt<0>::set_modulus, per thread.
+template <uint64_t M>
+class ModInt {
+public:
+    constexpr ModInt() : v(0) {}
+    constexpr ModInt(const uint64_t x) : v(ctx().reduce(x)) {}
+
+    static void set_modulus(const uint64_t n) requires (M == 0) { dynamic_ctx = Barrett64(n); }
+    static constexpr uint64_t modulus() { return ctx().n; }
+    constexpr uint64_t value() const { return v; }
+
+    constexpr ModInt &operator+=(const ModInt other) {
+        v = v >= modulus() - other.v ? v - (modulus() - other.v) : v + other.v;
+        return *this;
+    }
+    constexpr ModInt &operator-=(const ModInt other) {
+        v = v >= other.v ? v - other.v : v + (modulus() - other.v);
+        return *this;
+    }
+    constexpr ModInt &operator*=(const ModInt other) {
+        v = ctx().mul(v, other.v);
+        return *this;
+    }
+    friend constexpr ModInt operator+(ModInt a, const ModInt b) { return a += b; }
+    friend constexpr ModInt operator-(ModInt a, const ModInt b) { return a -= b; }
+    friend constexpr ModInt operator*(ModInt a, const ModInt b) { return a *= b; }
+    friend constexpr bool operator==(const ModInt a, const ModInt b) { return a.v == b.v; }
+
+    constexpr ModInt pow(const uint64_t e) const { return from_reduced(ctx().pow(v, e)); }
+
+    // Multiplicative inverse, 0 when gcd(v, M) != 1
+    constexpr ModInt inverse() const { return from_reduced(inverse_mod(v, modulus())); }
+
+private:
+    static constexpr const Barrett64 &ctx() {
+        if constexpr (M == 0) {
+            return dynamic_ctx;
+        } else {
+            return static_ctx;
+        }
+    }
+
+    static constexpr ModInt from_reduced(const uint64_t x) {
+        ModInt m;
+        m.v = x;
+        return m;
+    }
+
+    static constexpr Barrett64 static_ctx{M == 0 ? 1 : M};
+    inline static thread_local Barrett64 dynamic_ctx{1};
+
+    uint64_t v;
+};
+
+// Arithmetic mod 2^k (k <= 64): wrapping 64-bit products are already exact in the low k bits
+struct PowerOfTwo64 {
+    uint64_t mask;
+
+    constexpr uint64_t mul(const uint64_t a, const uint64_t b) const { return a * b; }
+};
+
+// Lanes exponentiations bases[l]^exps[l] run side by side: every step does the same operation on
+// all lanes, so the independent multiply chains overlap in the pipeline. Exponents are recoded into
+// fixed W-bit windows, shared by all lanes, with a table of base^0 .. base^(2^W - 1) per lane.
+template <size_t Lanes, typename Reducer>
+void pow_mod_lanes(const Reducer &r, const uint64_t *bases, const uint64_t *exps, uint64_t *out) {
+    constexpr bool montgomery = std::is_same_v<Reducer, Montgomery64>;
+    constexpr bool wrapping = std::is_same_v<Reducer, PowerOfTwo64>;
+    auto enter = [&](const uint64_t x) {
+        if constexpr (montgomery) {
+            return r.to_montgomery(x);
+        } else if constexpr (wrapping) {
+            return x;
+        } else {
+            return x % r.n;
+        }
+    };
+
+    uint64_t max_exp = 0;
+    for (size_t l = 0; l < Lanes; l++) {
+        max_exp |= exps[l];
+    }
+    int bits = 0;
+    while (bits < 64 && (max_exp >> bits) != 0) {
+        bits++;
+    }
+    const int W = bits <= 16 ? 2 : 4;
+
+    uint64_t table[Lanes][16];
+    uint64_t acc[Lanes];
+    for (size_t l = 0; l < Lanes; l++) {
+        table[l][0] = enter(1);
+        table[l][1] = enter(bases[l]);
+        for (int d = 2; d < (1 << W); d++) {
+            table[l][d] = r.mul(table[l][d - 1], table[l][1]);
+        }
+        acc[l] = table[l][0];
+    }
+
+    for (int w = (bits + W - 1) / W - 1; w >= 0; w--) {
+        for (int s = 0; s < W; s++) {
+            for (size_t l = 0; l < Lanes; l++) {
+                acc[l] = r.mul(acc[l], acc[l]);
+            }
+        }
+        for (size_t l = 0; l < Lanes; l++) {
+            acc[l] = r.mul(acc[l], table[l][(exps[l] >> (w * W)) & ((1 << W) - 1)]);
+        }
+    }
+
+    for (size_t l = 0; l < Lanes; l++) {
+        if constexpr (montgomery) {
+            out[l] = r.from_montgomery(acc[l]);
+        } else if constexpr (wrapping) {
+            out[l] = acc[l] & r.mask;
+        } else {
+            out[l] = acc[l];
+        }
+    }
+}
+
+// bases[i]^exps[i] mod m for every i, four at a time.
+// m = 2^s o with o odd runs Montgomery lanes mod o and wrapping lanes mod 2^s, then recombines by CRT,
+// which is much cheaper than Barrett reduction mod m itself.
+std::vector<uint64_t> pow_mod_batch(std::span<const uint64_t> bases, std::span<const uint64_t> exps, const uint64_t m) {
+    constexpr size_t Lanes = 4;
+
+    auto run = [&](const auto &reducer) {
+        std::vector<uint64_t> out(bases.size());
+        size_t i = 0;
+        for (; i + Lanes <= bases.size(); i += Lanes) {
+            pow_mod_lanes<Lanes>(reducer, &bases[i], &exps[i], &out[i]);
+        }
+        if (i < bases.size()) {
+            // pad the last group with 1^0
+            uint64_t b[Lanes] = {1, 1, 1, 1};
+            uint64_t e[Lanes] = {0, 0, 0, 0};
+            uint64_t o[Lanes];
+            std::copy(bases.begin() + i, bases.end(), b);
+            std::copy(exps.begin() + i, exps.end(), e);
+            pow_mod_lanes<Lanes>(reducer, b, e, o);
+            std::copy(o, o + (bases.size() - i), out.begin() + i);
+        }
+        return out;
+    };
+
+    const int s = m == 0 ? 0 : __builtin_ctzll(m);
+    const uint64_t odd = m >> s;
+    if (s == 0) {
+        return run(Montgomery64(m));
+    }
+    const uint64_t mask = (uint64_t{1} << s) - 1;
+    auto low = run(PowerOfTwo64{mask});
+    if (odd == 1) {
+        return low;
+    }
+
+    const Montgomery64 mont(odd);
+    auto out = run(mont);
+    // x = r_odd + odd * t with t = (r_low - r_odd) odd^-1 (mod 2^s); n_inv is odd^-1 mod 2^64
+    for (size_t i = 0; i < out.size(); i++) {
+        const uint64_t t = ((low[i] - out[i]) * mont.n_inv) & mask;
+        out[i] += odd * t;
+    }
+    return out;
+}
+
+// A nontrivial factor of an odd composite n, by Pollard's rho with Brent's cycle finding.
+// Differences are multiplied together in Montgomery form and checked with one gcd per batch.
+uint64_t pollard_rho(const uint64_t n) {
+    const Montgomery64 mont(n);
+    constexpr uint64_t batch = 128;
+    for (uint64_t c = 1;; c++) {
+        const uint64_t c_mont = mont.to_montgomery(c);
+        auto f = [&](const uint64_t x) {
+            return add_mod64(mont.mul(x, x), c_mont, n);
+        };
+        uint64_t x = mont.to_montgomery(2);
+        uint64_t y = x;
+        uint64_t saved = x;
+        uint64_t g = 1;
+        for (uint64_t len = 1; g == 1; len *= 2) {
+            x = y;
+            for (uint64_t i = 0; i < len; i++) {
+                y = f(y);
+            }
+            for (uint64_t done = 0; done < len && g == 1; done += batch) {
+                saved = y;
+                uint64_t q = mont.to_montgomery(1);
+                for (uint64_t i = 0; i < std::min(batch, len - done); i++) {
+                    y = f(y);
+                    q = mont.mul(q, x > y ? x - y : y - x);
+                }
+                g = std::gcd(q, n);
+            }
+        }
+        if (g == n) {
+            // the batch overshot: step back one difference at a time
+            do {
+                saved = f(saved);
+                g = std::gcd(x > saved ? x - saved : saved - x, n);
+            } while (g == 1);
+        }
+        if (g != n) {
+            return g;
+        }
+    }
+}
+
+// Prime factorization of n as (prime, exponent) pairs in increasing order. Small primes come
+// out by trial division; whatever is left is split by Pollard's rho until Miller-Rabin says prime.
+std::vector<std::pair<uint64_t, int>> factorize(uint64_t n) {
+    std::vector<std::pair<uint64_t, int>> factors;
+    uint64_t f = 2;
+    for (; f < 1'024 && f * f <= n; f += (f == 2 ? 1 : 2)) {
+        int e = 0;
+        while (n % f == 0) {
+            n /= f;
+            e++;
+        }
+        if (e > 0) {
+            factors.emplace_back(f, e);
+        }
+    }
+    if (n == 1) {
+        return factors;
+    }
+    if (f * f > n) {
+        factors.emplace_back(n, 1);
+        return factors;
+    }
+
+    std::vector<uint64_t> primes;
+    std::vector<uint64_t> pending{n};
+    while (!pending.empty()) {
+        const uint64_t m = pending.back();
+        pending.pop_back();
+        if (is_prime_u64(m)) {
+            primes.push_back(m);
+        } else {
+            const uint64_t d = pollard_rho(m);
+            pending.push_back(d);
+            pending.push_back(m / d);
+        }
+    }
+    std::sort(primes.begin(), primes.end());
+    for (const uint64_t p : primes) {
+        if (factors.empty() || factors.back().first != p) {
+            factors.emplace_back(p, 1);
+        } else {
+            factors.back().second++;
+        }
+    }
+    return factors;
+}
+
+// Carmichael's lambda of a prime power: the exponent of the unit group mod p^e,
+// so a^lambda = 1 (mod p^e) whenever p does not divide a
+uint64_t carmichael_lambda_prime_power(const uint64_t p, const int e) {
+    uint64_t pk = 1;
+    for (int i = 1; i < e; i++) {
+        pk *= p;
+    }
+    if (p == 2 && e >= 3) {
+        return pk / 2;
+    }
+    return pk * (p - 1);
+}
+
+// Arithmetic mod a composite n = prod p^e with known factorization, done on each prime power separately.
+// The power of two is plain masking, odd prime powers use Montgomery form, and residues are recombined
+// with Garner's algorithm from precomputed coefficients.
+class CrtModulus {
+public:
+    struct Part {
+        uint64_t p;
+        int e;
+        uint64_t q;             // p^e
+        Montgomery64 mont;      // unused for p = 2
+    };
+
+    explicit CrtModulus(const std::vector<std::pair<uint64_t, int>> &factorization) {
+        n_ = 1;
+        for (const auto &[p, e] : factorization) {
+            uint64_t q = 1;
+            for (int i = 0; i < e; i++) {
+                q *= p;
+            }
+            parts_.push_back(Part{p, e, q, Montgomery64(q | 1)});
+            n_ *= q;
+        }
+        // garner_[i] = (q_0 q_1 ... q_{i-1})^-1 mod q_i
+        for (size_t i = 0; i < parts_.size(); i++) {
+            const uint64_t q = parts_[i].q;
+            uint64_t prefix = 1 % q;
+            for (size_t j = 0; j < i; j++) {
+                prefix = mul_mod64(prefix, parts_[j].q % q, q);
+            }
+            garner_.push_back(inverse_mod(prefix, q));
+        }
+    }
+
+    explicit CrtModulus(const uint64_t n) : CrtModulus(factorize(n)) {}
+
+    uint64_t modulus() const { return n_; }
+    const std::vector<Part> &parts() const { return parts_; }
+
+    std::vector<uint64_t> split(const uint64_t x) const {
+        std::vector<uint64_t> residues;
+        for (const auto &part : parts_) {
+            residues.push_back(x % part.q);
+        }
+        return residues;
+    }
+
+    // The x < n with x = residues[i] (mod q_i) for every part
+    uint64_t combine(const std::vector<uint64_t> &residues) const {
+        uint64_t x = 0;
+        uint64_t prefix = 1;
+        for (size_t i = 0; i < parts_.size(); i++) {
+            const uint64_t q = parts_[i].q;
+            const uint64_t diff = sub_mod64(residues[i] % q, x % q, q);
+            x += prefix * mul_mod64(diff, garner_[i], q);
+            prefix *= q;
+        }
+        return x;
+    }
+
+    // a^e mod q_i
+    uint64_t pow_part(const size_t i, const uint64_t a, uint64_t e) const {
+        const Part &part = parts_[i];
+        if (part.p != 2) {
+            return part.mont.pow(a % part.q, e);
+        }
+        // mod 2^k, wrapping 64-bit arithmetic is already exact in the low k bits
+        const uint64_t mask = part.q - 1;
+        uint64_t acc = 1;
+        uint64_t base = a;
+        while (e > 0) {
+            if (e & 1) {
+                acc *= base;
+            }
+            base *= base;
+            e >>= 1;
+        }
+        return acc & mask;
+    }
+
+    uint64_t pow(const uint64_t a, const uint64_t e) const {
+        std::vector<uint64_t> residues(parts_.size());
+        for (size_t i = 0; i < parts_.size(); i++) {
+            residues[i] = pow_part(i, a, e);
+        }
+        return combine(residues);
+    }
+
+private:
+    uint64_t n_;
+    std::vector<Part> parts_;
+    std::vector<uint64_t> garner_;
+};
+
+// Euler's totient: how many 1 <= k <= n are coprime to n
+uint64_t phi(const uint64_t n) {
+    uint64_t result = n;
+    for (const auto &[p, e] : factorize(n)) {
+        result = result / p * (p - 1);
+    }
+    return result;
+}
+
+// Carmichael's lambda: the smallest L with a^L = 1 (mod n) for every a coprime to n
+uint64_t carmichael_lambda(const uint64_t n) {
+    uint64_t result = 1;
+    for (const auto &[p, e] : factorize(n)) {
+        const uint64_t l = carmichael_lambda_prime_power(p, e);
+        result = result / std::gcd(result, l) * l;
+    }
+    return result;
+}
+
+// a^b mod n with the exponent cut down per prime power part p^e of n:
+//  - p does not divide a: a^b = a^(b mod lambda(p^e))
+//  - p divides a and b >= e: p^e divides a^b, so the part is 0
+//  - otherwise b < e is already tiny
+uint64_t pow_mod_reduced(const uint64_t a, const uint64_t b, const CrtModulus &mod) {
+    const auto &parts = mod.parts();
+    std::vector<uint64_t> residues(parts.size());
+    for (size_t i = 0; i < parts.size(); i++) {
+        const auto &part = parts[i];
+        if (a % part.p != 0) {
+            residues[i] = mod.pow_part(i, a, b % carmichael_lambda_prime_power(part.p, part.e));
+        } else if (b >= static_cast<uint64_t>(part.e)) {
+            residues[i] = 0;
+        } else {
+            residues[i] = mod.pow_part(i, a, b);
+        }
+    }
+    return mod.combine(residues);
+}
+
+uint64_t pow_mod_reduced(const uint64_t a, const uint64_t b, const uint64_t n) {
+    return pow_mod_reduced(a, b, CrtModulus(n));
+}
+
+// Value of the tower tower[i] ^ (tower[i+1] ^ (...)), or cap if it is at least cap (cap <= 2^62)
+uint64_t tower_at_least(std::span<const uint64_t> tower, const uint64_t cap) {
+    if (tower.empty()) {
+        return std::min<uint64_t>(1, cap);
+    }
+    const uint64_t a = tower[0];
+    if (tower.size() == 1 || a == 1) {
+        return std::min(a, cap);
+    }
+    const uint64_t e = tower_at_least(tower.subspan(1), 64);
+    if (e == 0) {
+        return std::min<uint64_t>(1, cap);
+    }
+    if (a == 0) {
+        return 0;
+    }
+    // a >= 2, so a^64 is past any cap
+    uint64_t value = 1;
+    for (uint64_t i = 0; i < e; i++) {
+        if (value >= (cap + a - 1) / a) {
+            return cap;
+        }
+        value *= a;
+    }
+    return std::min(value, cap);
+}
+
+// tower[0] ^ (tower[1] ^ (tower[2] ^ ...)) mod n. Each level only needs the exponent above it
+// mod lambda(p^e) of each prime power part, or whether it reaches e, so the work is a handful of
+// exponentiations per level however tall the numbers get.
+uint64_t pow_mod_tower(std::span<const uint64_t> tower, const uint64_t n) {
+    if (n == 1) {
+        return 0;
+    }
+    if (tower.empty()) {
+        return 1;
+    }
+    if (tower.size() == 1) {
+        return tower[0] % n;
+    }
+    const uint64_t a = tower[0];
+    const auto above = tower.subspan(1);
+    const CrtModulus mod(n);
+    const auto &parts = mod.parts();
+    std::vector<uint64_t> residues(parts.size());
+    for (size_t i = 0; i < parts.size(); i++) {
+        const auto &part = parts[i];
+        if (a % part.p != 0) {
+            residues[i] = mod.pow_part(i, a, pow_mod_tower(above, carmichael_lambda_prime_power(part.p, part.e)));
+        } else {
+            const uint64_t e = tower_at_least(above, part.e);
+            residues[i] = e >= static_cast<uint64_t>(part.e) ? 0 : mod.pow_part(i, a, e);
+        }
+    }
+    return mod.combine(residues);
+}
+
+// Map from 64-bit keys to 64-bit values in one flat array with linear probing.
+// The key ~0 marks an empty slot, so it cannot be stored; nothing is ever erased.
+class FlatMap64 {
+public:
+    static constexpr uint64_t EMPTY = ~uint64_t{0};
+
+    explicit FlatMap64(const size_t expected) {
+        size_t capacity = 16;
+        while (capacity < 2 * expected) {
+            capacity *= 2;
+        }
+        slots_.assign(capacity, Slot{EMPTY, 0});
+        shift_ = 64 - __builtin_ctzll(capacity);
+    }
+
+    size_t size() const { return size_; }
+
+    // stores value unless key is already present
+    void insert(const uint64_t key, const uint64_t value) {
+        assert(key != EMPTY);
+        if (2 * (size_ + 1) > slots_.size()) {
+            grow();
+        }
+        for (size_t i = slot(key);; i = (i + 1) & (slots_.size() - 1)) {
+            if (slots_[i].key == key) {
+                return;
+            }
+            if (slots_[i].key == EMPTY) {
+                slots_[i] = Slot{key, value};
+                size_++;
+                return;
+            }
+        }
+    }
+
+    const uint64_t *find(const uint64_t key) const {
+        for (size_t i = slot(key);; i = (i + 1) & (slots_.size() - 1)) {
+            if (slots_[i].key == key) {
+                return &slots_[i].value;
+            }
+            if (slots_[i].key == EMPTY) {
+                return nullptr;
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint64_t value;
+    };
+
+    // Fibonacci hashing: the top bits of key * 2^64 / golden ratio
+    size_t slot(const uint64_t key) const { return (key * 0x9E37'79B9'7F4A'7C15ull) >> shift_; }
+
+    void grow() {
+        std::vector<Slot> old(2 * slots_.size(), Slot{EMPTY, 0});
+        old.swap(slots_);
+        shift_--;
+        size_ = 0;
+        for (const Slot &s : old) {
+            if (s.key != EMPTY) {
+                insert(s.key, s.value);
+            }
+        }
+    }
+
+    std::vector<Slot> slots_;
+    int shift_;
+    size_t size_ = 0;
+};
+
+// Order of a mod n: the smallest k > 0 with a^k = 1 (mod n), or 0 when gcd(a, n) != 1.
+// Starts from lambda(n), which every order divides, and strips its prime factors while a^(k/r) stays 1.
+uint64_t multiplicative_order(const uint64_t a, const CrtModulus &mod) {
+    const uint64_t n = mod.modulus();
+    if (n == 1) {
+        return 1;
+    }
+    if (std::gcd(a % n, n) != 1) {
+        return 0;
+    }
+    // lambda(n) and its prime factors from those of p - 1 and p for each part p^e
+    uint64_t order = 1;
+    std::vector<uint64_t> primes;
+    for (const auto &part : mod.parts()) {
+        const uint64_t l = carmichael_lambda_prime_power(part.p, part.e);
+        order = order / std::gcd(order, l) * l;
+        for (const auto &[r, e] : factorize(part.p - 1)) {
+            primes.push_back(r);
+        }
+        if (part.e > 1) {
+            primes.push_back(part.p);
+        }
+    }
+    std::sort(primes.begin(), primes.end());
+    primes.erase(std::unique(primes.begin(), primes.end()), primes.end());
+
+    for (const uint64_t r : primes) {
+        while (order % r == 0 && mod.pow(a, order / r) == 1) {
+            order /= r;
+        }
+    }
+    return order;
+}
+
+uint64_t multiplicative_order(const uint64_t a, const uint64_t n) {
+    return multiplicative_order(a, CrtModulus(n));
+}
+
+// Some x < order with g^x = h, where g has the given order, by baby-step giant-step:
+// g^j for j < m goes in a table, then h g^(-im) is looked up for i = 0, 1, ..., m - 1.
+std::optional<uint64_t> baby_step_giant_step(const uint64_t g, const uint64_t h, const uint64_t order, const Barrett64 &mod) {
+    uint64_t m = static_cast<uint64_t>(std::sqrt(static_cast<double>(order)));
+    while (m * m < order) {
+        m++;
+    }
+    FlatMap64 baby(m);
+    uint64_t x = mod.reduce(1);
+    for (uint64_t j = 0; j < m; j++) {
+        baby.insert(x, j);
+        x = mod.mul(x, g);
+    }
+    // x = g^m now
+    const uint64_t step = inverse_mod(x, mod.n);
+    uint64_t y = mod.reduce(h);
+    for (uint64_t i = 0; i < m; i++) {
+        if (const uint64_t *j = baby.find(y)) {
+            return i * m + *j;
+        }
+        y = mod.mul(y, step);
+    }
+    return std::nullopt;
+}
+
+// Smallest x >= 0 with a^x = b (mod n), if there is one.
+// Factors of gcd(a, n) are peeled off first, leaving a unit a. Its discrete log is then found by
+// Pohlig-Hellman: mod each prime power r^f dividing ord(a), digit by digit in base r, with one
+// baby-step giant-step search of size sqrt(r) per digit, and the results joined by CRT.
+// The cost is governed by the largest prime factor of ord(a), not by n.
+std::optional<uint64_t> discrete_log(uint64_t a, uint64_t b, uint64_t n) {
+    if (n == 1) {
+        return 0;
+    }
+    a %= n;
+    b %= n;
+
+    // a^k c = b (mod n) with everything divided through by the common factors so far
+    uint64_t k = 0;
+    uint64_t c = 1;
+    for (uint64_t g = std::gcd(a, n); g != 1; g = std::gcd(a, n)) {
+        if (c == b) {
+            return k;
+        }
+        if (b % g != 0) {
+            return std::nullopt;
+        }
+        b /= g;
+        n /= g;
+        k++;
+        c = mul_mod64(c, a / g, n);
+        a %= n;
+        b %= n;
+        if (n == 1) {
+            return k;
+        }
+    }
+    if (c == b % n) {
+        return k;
+    }
+
+    // a is a unit now, and so is c: solve a^y = t with t = b / c
+    const Barrett64 mod(n);
+    const uint64_t t = mod.mul(b, inverse_mod(c, n));
+    const uint64_t order = multiplicative_order(a, n);
+    const auto order_factors = factorize(order);
+
+    std::vector<uint64_t> residues;
+    for (const auto &[r, f] : order_factors) {
+        uint64_t rf = 1;
+        for (int i = 0; i < f; i++) {
+            rf *= r;
+        }
+        // project onto the subgroup of order r^f
+        const uint64_t a_r = mod.pow(a, order / rf);
+        const uint64_t t_r = mod.pow(t, order / rf);
+        const uint64_t a_r_inv = inverse_mod(a_r, n);
+        const uint64_t gamma = mod.pow(a_r, rf / r);    // order r
+
+        uint64_t y = 0;
+        uint64_t rk = 1;
+        for (int i = 0; i < f; i++) {
+            // (a_r^-y t_r)^(r^(f-1-i)) = gamma^(digit i)
+            const uint64_t h = mod.pow(mod.mul(mod.pow(a_r_inv, y), t_r), rf / rk / r);
+            const auto digit = baby_step_giant_step(gamma, h, r, mod);
+            if (!digit) {
+                return std::nullopt;
+            }
+            y += *digit * rk;
+            rk *= r;
+        }
+        residues.push_back(y);
+    }
+    const uint64_t y = order_factors.empty() ? 0 : CrtModulus(order_factors).combine(residues);
+    // t need not lie in the subgroup generated by a
+    if (mod.pow(a, y) != t) {
+        return std::nullopt;
+    }
+    return k + y;
+}
+
+// Fixed-width unsigned integer of Limbs 64-bit limbs, least significant first.
+// All arithmetic wraps mod 2^(64 Limbs); the limb count is a template parameter so every loop has a fixed trip count.
+template <size_t Limbs>
+struct UIntN {
+    std::array<uint64_t, Limbs> limb{};
+
+    constexpr UIntN() = default;
+    constexpr UIntN(const uint64_t x) { limb[0] = x; }
+
+    static constexpr UIntN power(uint64_t base, int e) {
+        UIntN x(1);
+        for (int i = 0; i < e; i++) {
+            x = mul_lo(x, UIntN(base));
+        }
+        return x;
+    }
+
+    constexpr bool is_zero() const {
+        for (const uint64_t l : limb) {
+            if (l != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr size_t bit_length() const {
+        for (size_t i = Limbs; i-- > 0;) {
+            if (limb[i] != 0) {
+                return 64 * i + 64 - __builtin_clzll(limb[i]);
+            }
+        }
+        return 0;
+    }
+
+    friend constexpr bool operator==(const UIntN &a, const UIntN &b) = default;
+
+    friend constexpr bool operator<(const UIntN &a, const UIntN &b) {
+        for (size_t i = Limbs; i-- > 0;) {
+            if (a.limb[i] != b.limb[i]) {
+                return a.limb[i] < b.limb[i];
+            }
+        }
+        return false;
+    }
+
+    friend constexpr UIntN operator+(const UIntN &a, const UIntN &b) {
+        UIntN r;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < Limbs; i++) {
+            const u128 sum = u128{a.limb[i]} + b.limb[i] + carry;
+            r.limb[i] = static_cast<uint64_t>(sum);
+            carry = static_cast<uint64_t>(sum >> 64);
+        }
+        return r;
+    }
+
+    friend constexpr UIntN operator-(const UIntN &a, const UIntN &b) {
+        UIntN r;
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < Limbs; i++) {
+            const u128 diff = u128{a.limb[i]} - b.limb[i] - borrow;
+            r.limb[i] = static_cast<uint64_t>(diff);
+            borrow = static_cast<uint64_t>(diff >> 64) & 1;
+        }
+        return r;
+    }
+
+    // low Limbs limbs of a * b
+    friend constexpr UIntN mul_lo(const UIntN &a, const UIntN &b) {
+        UIntN r;
+        for (size_t i = 0; i < Limbs; i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; i + j < Limbs; j++) {
+                const u128 t = u128{a.limb[j]} * b.limb[i] + r.limb[i + j] + carry;
+                r.limb[i + j] = static_cast<uint64_t>(t);
+                carry = static_cast<uint64_t>(t >> 64);
+            }
+        }
+        return r;
+    }
+
+    // keep the low k bits
+    constexpr UIntN low_bits(const size_t k) const {
+        UIntN r = *this;
+        for (size_t i = 0; i < Limbs; i++) {
+            if (64 * i >= k) {
+                r.limb[i] = 0;
+            } else if (64 * (i + 1) > k) {
+                r.limb[i] &= (uint64_t{1} << (k - 64 * i)) - 1;
+            }
+        }
+        return r;
+    }
+
+    // divides in place by d and returns the remainder
+    constexpr uint64_t divmod(const uint64_t d) {
+        u128 rem = 0;
+        for (size_t i = Limbs; i-- > 0;) {
+            const u128 cur = (rem << 64) | limb[i];
+            limb[i] = static_cast<uint64_t>(cur / d);
+            rem = cur % d;
+        }
+        return static_cast<uint64_t>(rem);
+    }
+
+    // decimal digits, zero padded on the left to at least width
+    std::string to_string(const size_t width = 1) const {
+        UIntN x = *this;
+        std::string digits;
+        while (!x.is_zero()) {
+            uint64_t chunk = x.divmod(10'000'000'000'000'000'000ull);
+            for (int i = 0; i < 19; i++) {
+                digits.push_back('0' + chunk % 10);
+                chunk /= 10;
+            }
+        }
+        while (digits.size() > 1 && digits.back() == '0') {
+            digits.pop_back();
+        }
+        if (digits.empty()) {
+            digits = "0";
+        }
+        while (digits.size() < width) {
+            digits.push_back('0');
+        }
+        return std::string(digits.rbegin(), digits.rend());
+    }
+};
+
+// Montgomery arithmetic mod an odd N < 2^(64 Limbs), with R = 2^(64 Limbs).
+// Products use the limb-interleaved CIOS reduction, so nothing is allocated and no division happens.
+template <size_t Limbs>
+class MontgomeryN {
+public:
+    using Int = UIntN<Limbs>;
+
+    explicit MontgomeryN(const Int &modulus) : n_(modulus) {
+        uint64_t inv = n_.limb[0];
+        for (int i = 0; i < 5; i++) {
+            inv *= 2 - n_.limb[0] * inv;
+        }
+        n_neg_inv_ = 0 - inv;
+
+        // R^2 mod N by doubling 1 2 * 64 * Limbs times
+        Int x(1);
+        for (size_t i = 0; i < 2 * 64 * Limbs; i++) {
+            const bool overflow = x.limb[Limbs - 1] >> 63;
+            x = x + x;
+            if (overflow || !(x < n_)) {
+                x = x - n_;
+            }
+        }
+        r2_ = x;
+    }
+
+    const Int &modulus() const { return n_; }
+    Int to_montgomery(const Int &a) const { return mul(a, r2_); }
+    Int from_montgomery(const Int &a) const { return mul(a, Int(1)); }
+
+    // a b R^-1 mod N
+    Int mul(const Int &a, const Int &b) const {
+        uint64_t t[Limbs + 2] = {};
+        for (size_t i = 0; i < Limbs; i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < Limbs; j++) {
+                const u128 s = u128{a.limb[j]} * b.limb[i] + t[j] + carry;
+                t[j] = static_cast<uint64_t>(s);
+                carry = static_cast<uint64_t>(s >> 64);
+            }
+            u128 s = u128{t[Limbs]} + carry;
+            t[Limbs] = static_cast<uint64_t>(s);
+            t[Limbs + 1] = static_cast<uint64_t>(s >> 64);
+
+            const uint64_t m = t[0] * n_neg_inv_;
+            s = u128{m} * n_.limb[0] + t[0];
+            carry = static_cast<uint64_t>(s >> 64);
+            for (size_t j = 1; j < Limbs; j++) {
+                s = u128{m} * n_.limb[j] + t[j] + carry;
+                t[j - 1] = static_cast<uint64_t>(s);
+                carry = static_cast<uint64_t>(s >> 64);
+            }
+            s = u128{t[Limbs]} + carry;
+            t[Limbs - 1] = static_cast<uint64_t>(s);
+            t[Limbs] = t[Limbs + 1] + static_cast<uint64_t>(s >> 64);
+        }
+        Int r;
+        std::copy(t, t + Limbs, r.limb.begin());
+        if (t[Limbs] != 0 || !(r < n_)) {
+            r = r - n_;
+        }
+        return r;
+    }
+
+    // a^e mod N for ordinary (not Montgomery form) a
+    Int pow(const Int &a, uint64_t e) const {
+        Int acc = to_montgomery(Int(1));
+        Int base = to_montgomery(a);
+        while (e > 0) {
+            if (e & 1) {
+                acc = mul(acc, base);
+            }
+            base = mul(base, base);
+            e >>= 1;
+        }
+        return from_montgomery(acc);
+    }
+
+private:
+    Int n_;
+    Int r2_;
+    uint64_t n_neg_inv_;
+};
+
+// Finds the k-term arithmetic progressions (k >= 3) in sorted sets of distinct integers.
+// For each middle term a two-pointer sweep over its left and right neighbours finds every
+// a_i + a_l = 2 a_j in O(m) steps, so all 3-term progressions cost O(m^2). For k > 3 a progression
+// ending in the pair (j, l) extends the one ending in (i, j): lengths are kept only for pairs that
+// end some progression, listed per last index in increasing order of the other one. The lists
+// are kept between calls, so after warming up a class costs no allocation.
+class ApDetector {
+public:
+    explicit ApDetector(const int k) : k_(k) { assert(k >= 3); }
+
+    int terms() const { return k_; }
+
+    // calls f(first, difference) for every k-term progression and returns how many there were
+    template <typename F>
+    uint64_t find(std::span<const uint64_t> set, F f) {
+        const size_t m = set.size();
+        if (m < static_cast<size_t>(k_)) {
+            return 0;
+        }
+        if (k_ > 3) {
+            if (ending_.size() < m) {
+                ending_.resize(m);
+            }
+            for (size_t i = 0; i < m; i++) {
+                ending_[i].clear();
+            }
+        }
+
+        uint64_t found = 0;
+        for (size_t j = 1; j + 1 < m; j++) {
+            const uint64_t twice = 2 * set[j];
+            size_t i = j - 1;
+            size_t l = j + 1;
+            while (l < m) {
+                const uint64_t sum = set[i] + set[l];
+                if (sum < twice) {
+                    l++;
+                } else if (sum > twice) {
+                    if (i == 0) {
+                        break;
+                    }
+                    i--;
+                } else {
+                    const uint64_t d = set[l] - set[j];
+                    if (k_ == 3) {
+                        found++;
+                        f(set[i], d);
+                    } else {
+                        const uint32_t length = length_ending(i, j) + 1;
+                        ending_[l].push_back(PairLength{static_cast<uint32_t>(j), length});
+                        if (length >= static_cast<uint32_t>(k_)) {
+                            found++;
+                            f(set[l] - (k_ - 1) * d, d);
+                        }
+                    }
+                    if (i == 0) {
+                        break;
+                    }
+                    i--;
+                    l++;
+                }
+            }
+        }
+        return found;
+    }
+
+private:
+    struct PairLength {
+        uint32_t first;         // index of the second to last term
+        uint32_t length;
+    };
+
+    // terms in the longest progression ending a_i, a_j; 2 when only the pair itself
+    uint32_t length_ending(const size_t i, const size_t j) const {
+        const auto &list = ending_[j];
+        const auto it = std::lower_bound(list.begin(), list.end(), i,
+                                         [](const PairLength &p, const size_t x) { return p.first < x; });
+        return it != list.end() && it->first == i ? it->length : 2;
+    }
+
+    int k_;
+    std::vector<std::vector<PairLength>> ending_;
+};
+
+// Odd composites n < limit that cannot be written as p + f(k) for a prime p and k >= 1.
+// f must be increasing. The set of covered n is the union of the prime bitmap shifted by every f(k) < limit,
+// built with word-level shift-OR one cache-sized block of words at a time so each block stays in L1 across all offsets.
+template <typename Offset>
+std::vector<uint64_t> uncovered_odd_composites(const Bitmap &primes, const uint64_t limit, Offset f, unsigned threads = 0) {
+    std::vector<uint64_t> offsets;
+    for (uint64_t k = 1; f(k) < limit; k++) {
+        offsets.push_back(f(k));
+    }
+
+    Bitmap covered(limit);
+    const uint64_t block_words = 4096;
+    const uint64_t blocks = (covered.words.size() + block_words - 1) / block_words;
+    parallel_for(0, blocks, [&](uint64_t b_lo, uint64_t b_hi) {
+        for (uint64_t b = b_lo; b < b_hi; b++) {
+            const uint64_t w_lo = b * block_words;
+            const uint64_t w_hi = std::min<uint64_t>(covered.words.size(), w_lo + block_words);
+            for (const uint64_t shift : offsets) {
+                if (shift / 64 >= w_hi) {
+                    break;
+                }
+                covered.or_shifted(primes, shift, w_lo, w_hi);
+            }
+        }
+    }, threads);
+    covered.trim();
+
+    std::vector<uint64_t> uncovered;
+    for (uint64_t n = 9; n < limit; n += 2) {
+        if (!covered.test(n) && !primes.test(n)) {
+            uncovered.push_back(n);
+        }
+    }
+    return uncovered;
+}
+
+constexpr uint32_t pow_mod32(uint32_t a, uint64_t e, const uint32_t mod) {
+    uint64_t acc = 1;
+    uint64_t base = a % mod;
+    while (e > 0) {
+        if (e & 1) {
+            acc = acc * base % mod;
+        }
+        base = base * base % mod;
+        e >>= 1;
+    }
+    return static_cast<uint32_t>(acc);
+}
+
+// In-place number theoretic transform mod the prime Mod = c 2^k + 1 (Mod < 2^32) with primitive root Root.
+// a.size() must be a power of two no larger than 2^k.
+// Each stage's butterflies are independent, so large transforms split every stage across threads.
+template <uint32_t Mod, uint32_t Root>
+void ntt(std::vector<uint32_t> &a, const bool invert, unsigned threads = 0) {
+    const uint64_t n = a.size();
+    assert((n & (n - 1)) == 0 && (Mod - 1) % n == 0);
+
+    for (uint64_t i = 1, j = 0; i < n; i++) {
+        uint64_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    if (n < (1 << 16)) {
+        threads = 1;
+    }
+
+    auto stage_root = [&](const uint64_t len) {
+        const uint32_t w = pow_mod32(Root, (Mod - 1) / len, Mod);
+        return invert ? pow_mod32(w, Mod - 2, Mod) : w;
+    };
+    // Twiddles are stored as (floor(w 2^32 / Mod) << 32) | w, which turns x * w mod Mod
+    // into two multiplications and a conditional subtraction (Shoup's trick) instead of a 128-bit division by constant
+    auto twiddle = [](const uint64_t w) {
+        return (((w << 32) / Mod) << 32) | w;
+    };
+    // count butterflies pairing x[j] with x[j + half]
+    auto butterflies = [&](uint32_t *x, const uint64_t *w, const uint64_t count, const uint64_t half) {
+        for (uint64_t j = 0; j < count; j++) {
+            const uint64_t u = x[j];
+            const uint64_t q = (x[j + half] * (w[j] >> 32)) >> 32;
+            uint64_t v = x[j + half] * (w[j] & 0xffffffff) - q * Mod;
+            // branch-free reductions, the comparisons are coin flips
+            v -= Mod & -uint64_t{v >= Mod};
+            const uint64_t sum = u + v;
+            const uint64_t diff = u + Mod - v;
+            x[j] = static_cast<uint32_t>(sum - (Mod & -uint64_t{sum >= Mod}));
+            x[j + half] = static_cast<uint32_t>(diff - (Mod & -uint64_t{diff >= Mod}));
+        }
+    };
+
+    // Stages up to len = B run one cache-sized block at a time, so only the
+    // longer stages stream the whole array. small[half + j] is the j-th twiddle of stage 2 half.
+    const uint64_t B = std::min<uint64_t>(n, 1 << 14);
+    std::vector<uint64_t> small(std::max<uint64_t>(B, 2));
+    for (uint64_t half = 1; half < B; half <<= 1) {
+        const uint64_t wlen = stage_root(2 * half);
+        uint64_t w = 1;
+        for (uint64_t j = 0; j < half; j++) {
+            small[half + j] = twiddle(w);
+            w = w * wlen % Mod;
+        }
+    }
+    parallel_for(0, n / B, [&](uint64_t lo, uint64_t hi) {
+        for (uint64_t b = lo; b < hi; b++) {
+            for (uint64_t half = 1; half < B; half <<= 1) {
+                for (uint64_t block = b * B; block < (b + 1) * B; block += 2 * half) {
+                    butterflies(&a[block], &small[half], half, half);
+                }
+            }
+        }
+    }, threads);
+
+    // twiddles of the current long stage, so the butterflies don't wait on a chain of multiplications
+    std::vector<uint64_t> twiddles(n > B ? n / 2 : 0);
+    for (uint64_t len = 2 * B; len <= n; len <<= 1) {
+        const uint64_t half = len / 2;
+        const uint64_t wlen = stage_root(len);
+        parallel_for(0, half, [&](uint64_t lo, uint64_t hi) {
+            uint64_t w = pow_mod32(static_cast<uint32_t>(wlen), lo, Mod);
+            for (uint64_t j = lo; j < hi; j++) {
+                twiddles[j] = twiddle(w);
+                w = w * wlen % Mod;
+            }
+        }, threads);
+
+        // split the stage into runs of B butterflies, which never straddle two blocks since B divides half
+        parallel_for(0, n / (2 * B), [&](uint64_t lo, uint64_t hi) {
+            for (uint64_t r = lo; r < hi; r++) {
+                const uint64_t t = r * B;
+                const uint64_t block = (t / half) * len;
+                const uint64_t j = t % half;
+                butterflies(&a[block + j], &twiddles[j], B, half);
+            }
+        }, threads);
+    }
+
+    if (invert) {
+        const uint64_t n_inv = pow_mod32(static_cast<uint32_t>(n % Mod), Mod - 2, Mod);
+        parallel_for(0, n, [&](uint64_t lo, uint64_t hi) {
+            for (uint64_t i = lo; i < hi; i++) {
+                a[i] = static_cast<uint32_t>(a[i] * n_inv % Mod);
+            }
+        }, threads);
+    }
+}
+
+// First out_len coefficients of a * b mod Mod
+template <uint32_t Mod, uint32_t Root>
+std::vector<uint32_t> convolve_mod(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, uint64_t out_len = 0, unsigned threads = 0) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+    const uint64_t full_len = a.size() + b.size() - 1;
+    if (out_len == 0 || out_len > full_len) {
+        out_len = full_len;
+    }
+    uint64_t n = 1;
+    while (n < full_len) {
+        n <<= 1;
+    }
+
+    std::vector<uint32_t> fa(n, 0);
+    std::vector<uint32_t> fb(n, 0);
+    for (size_t i = 0; i < a.size(); i++) {
+        fa[i] = a[i] % Mod;
+    }
+    for (size_t i = 0; i < b.size(); i++) {
+        fb[i] = b[i] % Mod;
+    }
+    ntt<Mod, Root>(fa, false, threads);
+    ntt<Mod, Root>(fb, false, threads);
+    parallel_for(0, n, [&](uint64_t lo, uint64_t hi) {
+        for (uint64_t i = lo; i < hi; i++) {
+            fa[i] = static_cast<uint32_t>(uint64_t{fa[i]} * fb[i] % Mod);
+        }
+    }, threads);
+    fb = {};
+    ntt<Mod, Root>(fa, true, threads);
+    fa.resize(out_len);
+    return fa;
+}
+
+// NTT primes with their primitive roots, transforms up to 2^30 and 2^27 long
+constexpr uint32_t NTT_PRIME_1 = 3'221'225'473;     // 3 * 2^30 + 1
+constexpr uint32_t NTT_ROOT_1 = 5;
+constexpr uint32_t NTT_PRIME_2 = 2'013'265'921;     // 15 * 2^27 + 1
+constexpr uint32_t NTT_ROOT_2 = 31;
+
+// Exact a * b for coefficient products summing to less than NTT_PRIME_1 * NTT_PRIME_2 (about 6.5e18):
+// convolve mod both primes and recombine with CRT (Garner).
+std::vector<uint64_t> convolve_exact(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, uint64_t out_len = 0, unsigned threads = 0) {
+    auto r1 = convolve_mod<NTT_PRIME_1, NTT_ROOT_1>(a, b, out_len, threads);
+    auto r2 = convolve_mod<NTT_PRIME_2, NTT_ROOT_2>(a, b, out_len, threads);
+    const uint64_t p1_inv = pow_mod32(NTT_PRIME_1 % NTT_PRIME_2, NTT_PRIME_2 - 2, NTT_PRIME_2);
+
+    std::vector<uint64_t> result(r1.size());
+    for (size_t i = 0; i < r1.size(); i++) {
+        const uint64_t diff = (uint64_t{r2[i]} + NTT_PRIME_2 - r1[i] % NTT_PRIME_2) % NTT_PRIME_2;
+        const uint64_t t = diff * p1_inv % NTT_PRIME_2;
+        result[i] = r1[i] + t * NTT_PRIME_1;
+    }
+    return result;
+}
+
+// Vector of trivially copyable T that keeps up to N elements inline and only
+// allocates once it grows past them.
+template <typename T, size_t N>
+class SmallVec {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    SmallVec() = default;
+    explicit SmallVec(const size_t n, const T value = T{}) { resize(n, value); }
+    SmallVec(const SmallVec &other) { assign(other.data(), other.size_); }
+    SmallVec(SmallVec &&other) noexcept { steal(other); }
+    ~SmallVec() { release(); }
+
+    SmallVec &operator=(const SmallVec &other) {
+        if (this != &other) {
+            size_ = 0;
+            assign(other.data(), other.size_);
+        }
+        return *this;
+    }
+
+    SmallVec &operator=(SmallVec &&other) noexcept {
+        if (this != &other) {
+            release();
+            steal(other);
+        }
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool is_inline() const { return heap_ == nullptr; }
+    T *data() { return heap_ ? heap_ : inline_; }
+    const T *data() const { return heap_ ? heap_ : inline_; }
+    T *begin() { return data(); }
+    T *end() { return data() + size_; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size_; }
+    T &operator[](const size_t i) { return data()[i]; }
+    const T &operator[](const size_t i) const { return data()[i]; }
+    T &back() { return data()[size_ - 1]; }
+    const T &back() const { return data()[size_ - 1]; }
+
+    void reserve(const size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        T *grown = new T[capacity];
+        std::copy(begin(), end(), grown);
+        delete[] heap_;
+        heap_ = grown;
+        capacity_ = capacity;
+    }
+
+    void resize(const size_t n, const T value = T{}) {
+        if (n > capacity_) {
+            reserve(std::max(n, 2 * capacity_));
+        }
+        if (n > size_) {
+            std::fill(data() + size_, data() + n, value);
+        }
+        size_ = n;
+    }
+
+    void push_back(const T value) {
+        resize(size_ + 1, value);
+    }
+
+    void pop_back() { size_--; }
+
+    friend bool operator==(const SmallVec &a, const SmallVec &b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end());
+    }
+
+private:
+    void assign(const T *src, const size_t n) {
+        reserve(n);
+        std::copy(src, src + n, data());
+        size_ = n;
+    }
+
+    void release() {
+        delete[] heap_;
+        heap_ = nullptr;
+        capacity_ = N;
+        size_ = 0;
+    }
+
+    void steal(SmallVec &other) {
+        if (other.heap_) {
+            heap_ = other.heap_;
+            capacity_ = other.capacity_;
+            size_ = other.size_;
+            other.heap_ = nullptr;
+            other.capacity_ = N;
+            other.size_ = 0;
+        } else {
+            // whole buffer, a fixed-size copy
+            std::copy(other.inline_, other.inline_ + N, inline_);
+            size_ = other.size_;
+        }
+    }
+
+    T *heap_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = N;
+    T inline_[N]{};
+};
+
+// Non-negative arbitrary-precision integer in base 2^32, least significant limb first,
+// with no leading zero limbs (zero has no limbs). Up to 256 bits stay inline.
+class BigInt {
+public:
+    using Limb = uint32_t;
+    using Limbs = SmallVec<Limb, 8>;
+
+    // shorter operand size in limbs where the next multiplication algorithm starts to win,
+    // measured with random balanced operands at -O2
+    static constexpr size_t KARATSUBA_THRESHOLD = 48;
+    static constexpr size_t NTT_THRESHOLD = 2'500;
+
+    BigInt() = default;
+
+    BigInt(uint64_t x) {
+        while (x > 0) {
+            limbs_.push_back(static_cast<Limb>(x));
+            x >>= 32;
+        }
+    }
+
+    explicit BigInt(const std::string &decimal) {
+        for (const char c : decimal) {
+            assert(c >= '0' && c <= '9');
+            mul_add_small(10, c - '0');
+        }
+    }
+
+    size_t size() const { return limbs_.size(); }
+    bool is_zero() const { return limbs_.empty(); }
+    const Limbs &limbs() const { return limbs_; }
+
+    // value mod 2^64
+    uint64_t low_u64() const {
+        uint64_t x = 0;
+        for (size_t i = std::min<size_t>(size(), 2); i-- > 0;) {
+            x = (x << 32) | limbs_[i];
+        }
+        return x;
+    }
+
+    size_t bit_length() const {
+        return is_zero() ? 0 : 32 * size() - __builtin_clz(limbs_.back());
+    }
+
+    friend bool operator==(const BigInt &a, const BigInt &b) { return a.limbs_ == b.limbs_; }
+
+    friend std::strong_ordering operator<=>(const BigInt &a, const BigInt &b) {
+        if (a.size() != b.size()) {
+            return a.size() <=> b.size();
+        }
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a.limbs_[i] != b.limbs_[i]) {
+                return a.limbs_[i] <=> b.limbs_[i];
+            }
+        }
+        return std::strong_ordering::equal;
+    }
+
+    BigInt &operator+=(const BigInt &b) {
+        add_shifted(b, 0);
+        return *this;
+    }
+
+    // requires *this >= b
+    BigInt &operator-=(const BigInt &b) {
+        assert(*this >= b);
+        int64_t borrow = 0;
+        for (size_t i = 0; i < size(); i++) {
+            if (i >= b.size() && borrow == 0) {
+                break;
             }
-            f += 6;
+            const int64_t diff = int64_t{limbs_[i]} - (i < b.size() ? b.limbs_[i] : 0) - borrow;
+            limbs_[i] = static_cast<Limb>(diff);
+            borrow = diff < 0;
         }
-        return true;
+        trim();
+        return *this;
     }
-}
 
-std::vector<bool> prime_sieve(int n) {
+    BigInt &operator*=(const BigInt &b) { return *this = *this * b; }
 
-    std::vector<bool> sieve(n+1, true);
+    friend BigInt operator+(BigInt a, const BigInt &b) { return a += b; }
+    friend BigInt operator-(BigInt a, const BigInt &b) { return a -= b; }
+    friend BigInt operator/(const BigInt &a, const BigInt &b) { return divmod(a, b).first; }
+    friend BigInt operator%(const BigInt &a, const BigInt &b) { return divmod(a, b).second; }
 
-    // Sieve remaining numbers
-    for (int i = 2; i*i <= n; i+=1) {
-        if (sieve[i]) {
-            for (int j = i*i; j <= n; j +=i) {
-                sieve[j] = false;
+    friend BigInt operator*(const BigInt &a, const BigInt &b) {
+        const size_t shorter = std::min(a.size(), b.size());
+        if (shorter < KARATSUBA_THRESHOLD) {
+            return mul_schoolbook(a, b);
+        }
+        if (shorter < NTT_THRESHOLD) {
+            return mul_karatsuba(a, b);
+        }
+        return mul_ntt(a, b);
+    }
+
+    static BigInt pow(const BigInt &base, uint64_t e) {
+        BigInt result(1);
+        for (int bit = e == 0 ? -1 : 63 - __builtin_clzll(e); bit >= 0; bit--) {
+            result = result * result;
+            if ((e >> bit) & 1) {
+                result = result * base;
             }
         }
+        return result;
     }
 
-    return sieve;
-}
+    // *this = *this * m + a
+    void mul_add_small(const Limb m, const Limb a) {
+        uint64_t carry = a;
+        for (Limb &l : limbs_) {
+            const uint64_t t = uint64_t{l} * m + carry;
+            l = static_cast<Limb>(t);
+            carry = t >> 32;
+        }
+        if (carry > 0) {
+            limbs_.push_back(static_cast<Limb>(carry));
+        }
+    }
 
-std::vector<int> primes(int n) {
-    auto sieve = prime_sieve(n);
-    std::vector<int> _primes{2};
-    for (int i = 3; i <= n; ++ i) {
-        if (sieve[i]) {
-            _primes.push_back(i);
+    // divides in place by d and returns the remainder
+    Limb divmod_small(const Limb d) {
+        uint64_t rem = 0;
+        for (size_t i = size(); i-- > 0;) {
+            const uint64_t cur = (rem << 32) | limbs_[i];
+            limbs_[i] = static_cast<Limb>(cur / d);
+            rem = cur % d;
         }
+        trim();
+        return static_cast<Limb>(rem);
     }
-    return _primes;
-}
+
+    // quotient and remainder by Knuth's algorithm D
+    static std::pair<BigInt, BigInt> divmod(const BigInt &u, const BigInt &v) {
+        assert(!v.is_zero());
+        if (u < v) {
+            return {BigInt(), u};
+        }
+        if (v.size() == 1) {
+            BigInt q = u;
+            const Limb r = q.divmod_small(v.limbs_[0]);
+            return {std::move(q), BigInt(r)};
+        }
+
+        // normalize so the divisor's top bit is set, which keeps each qhat within 2 of the truth
+        const size_t m = u.size();
+        const size_t n = v.size();
+        const int s = __builtin_clz(v.limbs_[n - 1]);
+        Limbs vn(n), un(m + 1);
+        for (size_t i = n; i-- > 0;) {
+            vn[i] = static_cast<Limb>((uint64_t{v.limbs_[i]} << s) | (i > 0 ? uint64_t{v.limbs_[i - 1]} >> (32 - s) : 0));
+        }
+        un[m] = static_cast<Limb>(uint64_t{u.limbs_[m - 1]} >> (32 - s));
+        for (size_t i = m; i-- > 0;) {
+            un[i] = static_cast<Limb>((uint64_t{u.limbs_[i]} << s) | (i > 0 ? uint64_t{u.limbs_[i - 1]} >> (32 - s) : 0));
+        }
+
+        BigInt q;
+        q.limbs_.resize(m - n + 1);
+        for (size_t j = m - n + 1; j-- > 0;) {
+            const uint64_t num = (uint64_t{un[j + n]} << 32) | un[j + n - 1];
+            uint64_t qhat = num / vn[n - 1];
+            uint64_t rhat = num % vn[n - 1];
+            while (qhat >> 32 || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+                qhat--;
+                rhat += vn[n - 1];
+                if (rhat >> 32) {
+                    break;
+                }
+            }
+
+            int64_t borrow = 0;
+            int64_t t = 0;
+            for (size_t i = 0; i < n; i++) {
+                const uint64_t p = qhat * vn[i];
+                t = int64_t{un[i + j]} - borrow - static_cast<int64_t>(p & 0xFFFF'FFFF);
+                un[i + j] = static_cast<Limb>(t);
+                borrow = static_cast<int64_t>(p >> 32) - (t >> 32);
+            }
+            t = int64_t{un[j + n]} - borrow;
+            un[j + n] = static_cast<Limb>(t);
+
+            // qhat was one too large: add the divisor back
+            if (t < 0) {
+                qhat--;
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; i++) {
+                    const uint64_t sum = uint64_t{un[i + j]} + vn[i] + carry;
+                    un[i + j] = static_cast<Limb>(sum);
+                    carry = sum >> 32;
+                }
+                un[j + n] += static_cast<Limb>(carry);
+            }
+            q.limbs_[j] = static_cast<Limb>(qhat);
+        }
+        q.trim();
+
+        BigInt r;
+        r.limbs_.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            r.limbs_[i] = static_cast<Limb>((uint64_t{un[i]} >> s) | (uint64_t{un[i + 1]} << (32 - s)));
+        }
+        r.trim();
+        return {std::move(q), std::move(r)};
+    }
+
+    // Decimal digits. Splits by 10^(9 * 2^k) from the top down, so the divisions run on
+    // balanced operands and only the leaves use short division.
+    std::string to_string() const {
+        if (is_zero()) {
+            return "0";
+        }
+        std::vector<BigInt> powers{BigInt(BILLION)};
+        while (2 * powers.back().size() <= size()) {
+            powers.push_back(powers.back() * powers.back());
+        }
+        std::string out;
+        out.reserve(10 * size() + 10);
+        write_decimal(*this, powers, static_cast<int>(powers.size()) - 1, 0, out);
+        return out;
+    }
+
+    static BigInt mul_schoolbook(const BigInt &a, const BigInt &b) {
+        if (a.is_zero() || b.is_zero()) {
+            return BigInt();
+        }
+        BigInt r;
+        r.limbs_.resize(a.size() + b.size());
+        for (size_t i = 0; i < a.size(); i++) {
+            uint64_t carry = 0;
+            const uint64_t ai = a.limbs_[i];
+            for (size_t j = 0; j < b.size(); j++) {
+                const uint64_t t = ai * b.limbs_[j] + r.limbs_[i + j] + carry;
+                r.limbs_[i + j] = static_cast<Limb>(t);
+                carry = t >> 32;
+            }
+            r.limbs_[i + b.size()] = static_cast<Limb>(carry);
+        }
+        r.trim();
+        return r;
+    }
+
+    // a * b = z2 B^2h + ((a0 + a1)(b0 + b1) - z0 - z2) B^h + z0 with h half the longer operand;
+    // recursion goes back through operator* so small or lopsided halves pick their own method
+    static BigInt mul_karatsuba(const BigInt &a, const BigInt &b) {
+        const size_t half = std::max(a.size(), b.size()) / 2;
+        if (std::min(a.size(), b.size()) <= half) {
+            // lopsided: split only the longer operand
+            const BigInt &longer = a.size() > b.size() ? a : b;
+            const BigInt &shorter = a.size() > b.size() ? b : a;
+            BigInt r = longer.slice(0, half) * shorter;
+            r.add_shifted(longer.slice(half, longer.size()) * shorter, half);
+            return r;
+        }
+        const BigInt a0 = a.slice(0, half), a1 = a.slice(half, a.size());
+        const BigInt b0 = b.slice(0, half), b1 = b.slice(half, b.size());
+        const BigInt z0 = a0 * b0;
+        const BigInt z2 = a1 * b1;
+        BigInt z1 = (a0 + a1) * (b0 + b1);
+        z1 -= z0;
+        z1 -= z2;
+        BigInt r = z0;
+        r.add_shifted(z1, half);
+        r.add_shifted(z2, 2 * half);
+        return r;
+    }
+
+    // exact convolution of 16-bit pieces, so every coefficient stays below 2^32 * length
+    static BigInt mul_ntt(const BigInt &a, const BigInt &b) {
+        if (a.is_zero() || b.is_zero()) {
+            return BigInt();
+        }
+        auto pieces = [](const BigInt &x) {
+            std::vector<uint32_t> p(2 * x.size());
+            for (size_t i = 0; i < x.size(); i++) {
+                p[2 * i] = x.limbs_[i] & 0xFFFF;
+                p[2 * i + 1] = x.limbs_[i] >> 16;
+            }
+            return p;
+        };
+        const std::vector<uint64_t> coeffs = convolve_exact(pieces(a), pieces(b));
+
+        BigInt r;
+        r.limbs_.resize(a.size() + b.size());
+        uint64_t carry = 0;
+        for (size_t i = 0; i < 2 * r.size(); i++) {
+            const uint64_t t = (i < coeffs.size() ? coeffs[i] : 0) + carry;
+            r.limbs_[i / 2] |= static_cast<Limb>((t & 0xFFFF) << (16 * (i % 2)));
+            carry = t >> 16;
+        }
+        r.trim();
+        return r;
+    }
+
+private:
+    static constexpr Limb BILLION = 1'000'000'000;
+
+    void trim() {
+        while (!limbs_.empty() && limbs_.back() == 0) {
+            limbs_.pop_back();
+        }
+    }
+
+    // limbs [lo, hi) as a number
+    BigInt slice(const size_t lo, size_t hi) const {
+        BigInt r;
+        hi = std::min(hi, size());
+        if (lo < hi) {
+            r.limbs_.resize(hi - lo);
+            std::copy(limbs_.begin() + lo, limbs_.begin() + hi, r.limbs_.begin());
+            r.trim();
+        }
+        return r;
+    }
+
+    // *this += b * 2^(32 shift)
+    void add_shifted(const BigInt &b, const size_t shift) {
+        if (b.is_zero()) {
+            return;
+        }
+        if (size() < b.size() + shift) {
+            limbs_.resize(b.size() + shift);
+        }
+        uint64_t carry = 0;
+        size_t i = shift;
+        for (; i < b.size() + shift; i++) {
+            const uint64_t t = uint64_t{limbs_[i]} + b.limbs_[i - shift] + carry;
+            limbs_[i] = static_cast<Limb>(t);
+            carry = t >> 32;
+        }
+        for (; carry > 0 && i < size(); i++) {
+            const uint64_t t = uint64_t{limbs_[i]} + carry;
+            limbs_[i] = static_cast<Limb>(t);
+            carry = t >> 32;
+        }
+        if (carry > 0) {
+            limbs_.push_back(static_cast<Limb>(carry));
+        }
+    }
+
+    // appends x in decimal, zero padded to width digits when width > 0;
+    // powers[k] = 10^(9 * 2^k)
+    static void write_decimal(BigInt x, const std::vector<BigInt> &powers, int k, const size_t width, std::string &out) {
+        while (k >= 0 && x < powers[k] && width == 0) {
+            k--;
+        }
+        if (k < 0 || x.size() <= 2 * KARATSUBA_THRESHOLD) {
+            std::string digits;
+            while (!x.is_zero()) {
+                Limb chunk = x.divmod_small(BILLION);
+                for (int i = 0; i < 9; i++) {
+                    digits.push_back('0' + chunk % 10);
+                    chunk /= 10;
+                }
+            }
+            while (!digits.empty() && digits.back() == '0') {
+                digits.pop_back();
+            }
+            if (digits.size() < width) {
+                digits.append(width - digits.size(), '0');
+            }
+            out.append(digits.rbegin(), digits.rend());
+            return;
+        }
+        const size_t low_width = size_t{9} << k;
+        auto [high, low] = divmod(x, powers[k]);
+        write_decimal(std::move(high), powers, k - 1, width > 0 ? width - low_width : 0, out);
+        write_decimal(std::move(low), powers, k - 1, low_width, out);
+    }
+
+    Limbs limbs_;
+};
 
 std::vector<int> prime_factors(const int n) {
     std::vector<int> factors{};
@@ -167,6 +2493,115 @@ int num_prime_factors(const int n) {
     return N;
 }
 
+struct Run {
+    uint64_t start = 0;
+    uint64_t length = 0;
+
+    bool operator==(const Run &) const = default;
+};
+
+enum class RunMode { First, All };
+
+// Maximal runs of at least k consecutive n in [begin, end) satisfying a predicate.
+// kernel(lo, hi, out) sets out[i] = P(lo + i) for a block [lo, hi), so the predicate is evaluated once per
+// element in blocks the kernel is free to vectorize. The range is cut into chunks that threads take in order;
+// each chunk keeps its leading and trailing runs whatever their length, and those are stitched
+// to the neighbouring chunks afterwards. In First mode chunks past one that already holds a full run are skipped,
+// and only the first run is returned (its length is then only known to be >= k).
+template <typename Kernel>
+std::vector<Run> find_runs(const uint64_t begin, const uint64_t end, Kernel kernel, const uint64_t k,
+                           const RunMode mode = RunMode::All, unsigned threads = 0) {
+    if (end <= begin || k == 0) {
+        return {};
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const uint64_t block_size = 4096;
+    const uint64_t num_chunks = std::min<uint64_t>(8 * threads, (end - begin + block_size - 1) / block_size);
+    const uint64_t chunk_size = (end - begin + num_chunks - 1) / num_chunks;
+
+    std::vector<std::vector<Run>> chunk_runs(num_chunks);
+    std::vector<char> evaluated(num_chunks, false);
+    std::atomic<uint64_t> next_chunk{0};
+    std::atomic<uint64_t> first_found{num_chunks};
+
+    auto worker = [&] {
+        std::vector<uint8_t> block(block_size);
+        for (uint64_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+            if (mode == RunMode::First && c > first_found) {
+                continue;
+            }
+            const uint64_t lo = begin + c * chunk_size;
+            const uint64_t hi = std::min(end, lo + chunk_size);
+            auto &runs = chunk_runs[c];
+            Run current{lo, 0};
+
+            for (uint64_t b_lo = lo; b_lo < hi; b_lo += block_size) {
+                const uint64_t b_hi = std::min(hi, b_lo + block_size);
+                kernel(b_lo, b_hi, block.data());
+                for (uint64_t i = 0; i < b_hi - b_lo; i++) {
+                    if (block[i]) {
+                        current.length++;
+                        continue;
+                    }
+                    // runs touching either end of the chunk may grow once stitched
+                    if (current.length >= k || (current.length > 0 && current.start == lo)) {
+                        runs.push_back(current);
+                    }
+                    current = Run{b_lo + i + 1, 0};
+                }
+            }
+            if (current.length > 0) {
+                runs.push_back(current);
+            }
+            evaluated[c] = true;
+
+            if (mode == RunMode::First) {
+                for (const auto &run : runs) {
+                    if (run.length >= k) {
+                        uint64_t seen = first_found;
+                        while (c < seen && !first_found.compare_exchange_weak(seen, c)) {
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < std::min<uint64_t>(threads, num_chunks); t++) {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+
+    std::vector<Run> result;
+    Run pending{};
+    for (uint64_t c = 0; c < num_chunks && evaluated[c]; c++) {
+        for (const auto &run : chunk_runs[c]) {
+            if (pending.length > 0 && pending.start + pending.length == run.start) {
+                pending.length += run.length;
+                continue;
+            }
+            if (pending.length >= k) {
+                result.push_back(pending);
+                if (mode == RunMode::First) {
+                    return result;
+                }
+            }
+            pending = run;
+        }
+    }
+    if (pending.length >= k) {
+        result.push_back(pending);
+    }
+    return result;
+}
+
 TEST_CASE("Primes") {
 
     int N = 100;
@@ -185,7 +2620,7 @@ TEST_CASE("Primes") {
     CHECK(!sieve[12]);
     CHECK(sieve[13]);
 
-    for (size_t i = 0; i <= p.size(); i ++) {
+    for (size_t i = 0; i < p.size(); i ++) {
         CHECK(sieve[p[i]]);
     }
 
@@ -209,3 +2644,542 @@ TEST_CASE("Prime factors") {
     }
 }
 
+TEST_CASE("Figurate index") {
+    FigurateIndex<5> small(1'000);
+    FigurateIndex<5> large(10'000'000);
+    FigurateIndex<3> triangles(5'000);
+    CHECK(!small.sparse());
+    CHECK(large.sparse());
+
+    for (uint64_t x = 1; x <= 1'000; x++) {
+        CHECK(small.contains(x) == is_pentagonal(static_cast<double>(x)));
+        CHECK(triangles.contains(x) == is_triangular(static_cast<double>(x)));
+    }
+    for (uint64_t x = 9'990'000; x <= 10'000'000; x++) {
+        CHECK(large.contains(x) == is_pentagonal(static_cast<double>(x)));
+    }
+    CHECK(!small.contains(1'001));
+
+    FigurateIndex<5> threaded(20'000, 4);
+    CHECK(!threaded.sparse());
+    for (uint64_t x = 1; x <= 20'000; x++) {
+        CHECK(threaded.contains(x) == is_pentagonal(static_cast<double>(x)));
+    }
+    CHECK(threaded.contains(polygonal<5>(uint64_t{115})));
+
+    std::vector<uint64_t> seen;
+    large.for_each(20, 100, [&](uint64_t x) { seen.push_back(x); });
+    CHECK(seen == std::vector<uint64_t>{22, 35, 51, 70, 92});
+    CHECK(large.size() == polygonal_count<5>(10'000'000));
+}
+
+TEST_CASE("Bitmap") {
+    auto sieve = prime_sieve(1'000);
+    auto bitmap = prime_bitmap(1'000);
+    for (int i = 0; i <= 1'000; i++) {
+        CHECK(bitmap.test(i) == (i >= 2 && sieve[i]));
+    }
+
+    Bitmap shifted(300);
+    shifted.or_shifted(bitmap, 70);
+    for (int i = 0; i < 300; i++) {
+        CHECK(shifted.test(i) == (i >= 70 && bitmap.test(i - 70)));
+    }
+
+    // the bits carried out of the source's top word land in the word past it
+    Bitmap top(128);
+    top.set(127);
+    top.set(100);
+    Bitmap wide(400);
+    wide.or_shifted(top, 70);
+    for (int i = 0; i < 400; i++) {
+        CHECK(wide.test(i) == (i == 170 || i == 197));
+    }
+    Bitmap windowed(400);
+    windowed.or_shifted(top, 70, 3, 4);
+    CHECK(windowed.test(197));
+    CHECK(!windowed.test(170));
+
+    // n = p + k^2, checked against trial division
+    auto squares = uncovered_odd_composites(prime_bitmap(2'000), 2'000, [](uint64_t k) { return k * k; }, 3);
+    std::vector<uint64_t> expected;
+    for (int n = 9; n < 2'000; n += 2) {
+        bool covered = is_prime(n);
+        for (int k = 1; k * k < n; k++) {
+            covered = covered || is_prime(n - k * k);
+        }
+        if (!covered) {
+            expected.push_back(n);
+        }
+    }
+    CHECK(squares == expected);
+}
+
+TEST_CASE("Segmented sieve") {
+    auto sieve = prime_bitmap(20'000);
+    std::vector<uint64_t> base;
+    for (uint64_t i = 2; i * i <= 20'000; i++) {
+        if (sieve.test(i)) {
+            base.push_back(i);
+        }
+    }
+    for (const uint64_t lo : {0, 1, 7'777, 19'000}) {
+        auto segment = segmented_prime_bitmap(lo, 20'000, base);
+        for (uint64_t n = lo; n < 20'000; n++) {
+            CHECK(segment.test(n - lo) == sieve.test(n));
+        }
+    }
+    for (uint64_t n = 0; n < 20'000; n++) {
+        CHECK(is_prime_u64(n) == sieve.test(n));
+    }
+    CHECK(is_prime_u64(1'000'000'000'039ull));
+    CHECK(!is_prime_u64(3'215'031'751ull));        // strong pseudoprime to bases 2, 3, 5, 7
+    CHECK(is_prime_u64(18'446'744'073'709'551'557ull));
+}
+
+TEST_CASE("NTT convolution") {
+    std::vector<uint32_t> a{1, 2, 3};
+    std::vector<uint32_t> b{4, 5};
+    CHECK(convolve_mod<NTT_PRIME_1, NTT_ROOT_1>(a, b) == std::vector<uint32_t>{4, 13, 22, 15});
+
+    // coefficients well past either prime need the CRT recombination
+    std::vector<uint32_t> big(100, 60'000'000);
+    auto square = convolve_exact(big, big);
+    CHECK(square.size() == 199);
+    CHECK(square[0] == 3'600'000'000'000'000ull);
+    CHECK(square[99] == 360'000'000'000'000'000ull);
+    CHECK(square[198] == 3'600'000'000'000'000ull);
+
+    // threaded butterflies agree with the serial ones
+    std::vector<uint32_t> x(1 << 16);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = (i * 7919) % 1000;
+    }
+    auto serial = x;
+    auto threaded = x;
+    ntt<NTT_PRIME_1, NTT_ROOT_1>(serial, false, 1);
+    ntt<NTT_PRIME_1, NTT_ROOT_1>(threaded, false, 4);
+    CHECK(serial == threaded);
+    ntt<NTT_PRIME_1, NTT_ROOT_1>(threaded, true, 4);
+    CHECK(threaded == x);
+}
+
+TEST_CASE("Runs") {
+    // runs of nine, with a few cut short, checked against a serial scan
+    auto kernel = [](uint64_t lo, uint64_t hi, uint8_t *out) {
+        for (uint64_t n = lo; n < hi; n++) {
+            out[n - lo] = (n % 13 < 9) && (n % 1000 != 999);
+        }
+    };
+    std::vector<Run> expected;
+    Run current{};
+    for (uint64_t n = 5; n < 50'000; n++) {
+        uint8_t p;
+        kernel(n, n + 1, &p);
+        if (p) {
+            current.start = current.length == 0 ? n : current.start;
+            current.length++;
+        } else {
+            if (current.length >= 7) {
+                expected.push_back(current);
+            }
+            current = Run{};
+        }
+    }
+    if (current.length >= 7) {
+        expected.push_back(current);
+    }
+
+    for (unsigned threads : {1, 3, 8}) {
+        CHECK(find_runs(5, 50'000, kernel, 7, RunMode::All, threads) == expected);
+        auto first = find_runs(5, 50'000, kernel, 7, RunMode::First, threads);
+        REQUIRE(first.size() == 1);
+        CHECK(first[0].start == expected[0].start);
+    }
+    CHECK(find_runs(5, 50'000, kernel, 10).empty());
+}
+
+TEST_CASE("Modular arithmetic") {
+    static_assert(ModInt<1'000'000'007>(2).pow(30).value() == 73'741'817);
+    static_assert((ModInt<10'000'000'000>(3).inverse() * 3).value() == 1);
+
+    const uint64_t moduli[] = {1, 2, 7, 1'000'000'007, 10'000'000'000, 4'611'686'018'427'387'847ull, 18'446'744'073'709'551'557ull};
+    uint64_t x = 88'172'645'463'325'252ull;
+    for (const uint64_t n : moduli) {
+        Barrett64 barrett(n);
+        Montgomery64 montgomery(n | 1);
+        for (int i = 0; i < 200; i++) {
+            // xorshift
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            const uint64_t a = x % n;
+            const uint64_t b = (x >> 17) % n;
+            CHECK(barrett.mul(a, b) == mul_mod64(a, b, n));
+            CHECK(barrett.reduce(x) == x % n);
+            const uint64_t m = n | 1;
+            CHECK(montgomery.from_montgomery(montgomery.mul(montgomery.to_montgomery(a), montgomery.to_montgomery(b))) == mul_mod64(a, b, m));
+            CHECK(montgomery.pow(a, b) == pow_mod64(a, b, m));
+            CHECK(barrett.pow(a, b) == pow_mod64(a, b, n));
+        }
+    }
+
+    ModInt<0>::set_modulus(229);
+    ModInt<0> a(117);
+    CHECK(a.pow(1023).value() == 141);
+    CHECK((a * a.inverse()).value() == 1);
+    CHECK((a - ModInt<0>(200)).value() == 146);
+    CHECK((a + ModInt<0>(200)).value() == 88);
+    CHECK(ModInt<10>(4).inverse().value() == 0);
+}
+
+TEST_CASE("CRT modulus") {
+    CHECK(carmichael_lambda_prime_power(2, 1) == 1);
+    CHECK(carmichael_lambda_prime_power(2, 2) == 2);
+    CHECK(carmichael_lambda_prime_power(2, 10) == 256);
+    CHECK(carmichael_lambda_prime_power(5, 10) == 7'812'500);
+
+    CHECK(factorize(10'000'000'000) == std::vector<std::pair<uint64_t, int>>{{2, 10}, {5, 10}});
+    CHECK(factorize(1).empty());
+    CHECK(factorize(999'999'999'989).size() == 1);
+
+    for (const uint64_t n : {10'000'000'000ull, 360ull, 1'000'000'007ull, 2ull * 3 * 5 * 7 * 11 * 13 * 17 * 19 * 23 * 29 * 31 * 37, 1ull << 40}) {
+        CrtModulus crt(n);
+        CHECK(crt.modulus() == n);
+        for (uint64_t a = n / 3; a < n / 3 + 50; a++) {
+            CHECK(crt.combine(crt.split(a)) == a);
+            CHECK(crt.pow(a, a + 12'345) == pow_mod64(a, a + 12'345, n));
+        }
+    }
+
+    // a prime part above 2^63, where a plain q + r - x would wrap
+    const uint64_t big = 18'446'744'073'709'551'557ull;
+    const CrtModulus big_crt(big);
+    CHECK(big_crt.combine(big_crt.split(10'000'000'000'000'000'000ull)) == 10'000'000'000'000'000'000ull);
+    CHECK(big_crt.combine(big_crt.split(big - 1)) == big - 1);
+    uint64_t a = 88'172'645'463'325'252ull;
+    for (int i = 0; i < 20; i++) {
+        a ^= a << 13;
+        a ^= a >> 7;
+        a ^= a << 17;
+        CHECK(pow_mod_reduced(a, a >> 3, big_crt) == pow_mod64(a, a >> 3, big));
+    }
+}
+
+TEST_CASE("Batched powers") {
+    std::vector<uint64_t> bases;
+    std::vector<uint64_t> exps;
+    uint64_t x = 2'463'534'242;
+    for (int i = 0; i < 103; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        bases.push_back(x);
+        exps.push_back(i % 3 == 0 ? x >> (i % 64) : i);
+    }
+    for (const uint64_t m : {1ull, 2ull, 1'000ull, 10'000'000'000ull, 1'000'000'007ull, 18'446'744'073'709'551'557ull}) {
+        auto powers = pow_mod_batch(bases, exps, m);
+        REQUIRE(powers.size() == bases.size());
+        for (size_t i = 0; i < bases.size(); i++) {
+            CHECK(powers[i] == pow_mod64(bases[i], exps[i], m));
+        }
+    }
+}
+
+TEST_CASE("Totients and reduced exponents") {
+    CHECK(phi(1) == 1);
+    CHECK(phi(36) == 12);
+    CHECK(phi(10'000'000'000) == 4'000'000'000);
+    CHECK(carmichael_lambda(1) == 1);
+    CHECK(carmichael_lambda(8) == 2);
+    CHECK(carmichael_lambda(561) == 80);
+    CHECK(carmichael_lambda(10'000'000'000) == 500'000'000);
+
+    for (int n = 1; n < 200; n++) {
+        int coprime = 0;
+        for (int k = 1; k <= n; k++) {
+            coprime += std::gcd(k, n) == 1;
+        }
+        CHECK(phi(n) == static_cast<uint64_t>(coprime));
+    }
+
+    const CrtModulus ten_ten(10'000'000'000);
+    for (uint64_t a = 0; a < 60; a++) {
+        for (const uint64_t b : {0ull, 1ull, 9ull, 10ull, 11ull, 500'000'000ull, 123'456'789'012'345ull}) {
+            CHECK(pow_mod_reduced(a, b, ten_ten) == pow_mod64(a, b, 10'000'000'000));
+        }
+    }
+
+    const uint64_t threes[] = {3, 3, 3};
+    const uint64_t four_threes[] = {3, 3, 3, 3};
+    const uint64_t twos[] = {2, 2, 2, 2, 2};
+    const uint64_t tens[] = {10, 3, 3, 3};
+    const uint64_t zeros[] = {3, 0, 5};
+    CHECK(pow_mod_tower(threes, 10'000'000'000) == 5'597'484'987);
+    CHECK(pow_mod_tower(four_threes, 10'000'000'000) == 6'100'739'387);
+    CHECK(pow_mod_tower(twos, 10'000'000'000) == 5'719'156'736);
+    CHECK(pow_mod_tower(tens, 10'000'000'000) == 0);
+    CHECK(pow_mod_tower(zeros, 10) == 1);
+    CHECK(tower_at_least(threes, uint64_t{1} << 62) == 7'625'597'484'987);
+}
+
+TEST_CASE("Orders and discrete logs") {
+    // Pollard rho on semiprimes and prime powers past the trial division bound
+    CHECK(factorize(998'244'359'987'710'471ull) == std::vector<std::pair<uint64_t, int>>{{998'244'353, 1}, {1'000'000'007, 1}});
+    CHECK(factorize(18'446'743'979'220'271'189ull) == std::vector<std::pair<uint64_t, int>>{{4'294'967'279, 1}, {4'294'967'291, 1}});
+    // semiprimes above 2^63, where x^2 + c in Montgomery form can pass 2^64 before it is reduced
+    CHECK(factorize(18'446'743'073'710'200'941ull) == std::vector<std::pair<uint64_t, int>>{{1'000'003, 1}, {18'446'687'733'647ull, 1}});
+    CHECK(factorize(9'223'409'107'414'923'977ull) == std::vector<std::pair<uint64_t, int>>{{3'000'000'019, 1}, {3'074'469'683, 1}});
+    CHECK(factorize(9'223'425'196'752'297'319ull) == std::vector<std::pair<uint64_t, int>>{{2'147'364'937, 1}, {4'295'229'487, 1}});
+    for (const uint64_t n : {18'446'743'073'710'200'941ull, 9'223'409'107'414'923'977ull}) {
+        const uint64_t d = pollard_rho(n);
+        CHECK((d > 1 && d < n && n % d == 0));
+    }
+    CHECK(factorize(2'305'843'009'213'693'951ull) == std::vector<std::pair<uint64_t, int>>{{2'305'843'009'213'693'951ull, 1}});
+    CHECK(factorize(1'031ull * 1'031 * 1'033 * 1'033 * 1'033) == std::vector<std::pair<uint64_t, int>>{{1'031, 2}, {1'033, 3}});
+    for (uint64_t n = 1'000'000'000'000'000'000ull; n < 1'000'000'000'000'000'050ull; n++) {
+        uint64_t product = 1;
+        for (const auto &[p, e] : factorize(n)) {
+            CHECK(is_prime_u64(p));
+            for (int i = 0; i < e; i++) {
+                product *= p;
+            }
+        }
+        CHECK(product == n);
+    }
+
+    // orders and logs against brute force, including a sharing factors with n
+    for (uint64_t n = 1; n <= 36; n++) {
+        for (uint64_t a = 0; a < n; a++) {
+            uint64_t order = 0;
+            if (std::gcd(a, n) == 1) {
+                order = 1;
+                while (pow_mod64(a, order, n) != 1 % n) {
+                    order++;
+                }
+            }
+            CHECK(multiplicative_order(a, n) == order);
+            for (uint64_t b = 0; b < n; b++) {
+                std::optional<uint64_t> expected;
+                for (uint64_t x = 0; x <= 2 * n && !expected; x++) {
+                    if (pow_mod64(a, x, n) == b % n) {
+                        expected = x;
+                    }
+                }
+                CHECK(discrete_log(a, b, n) == expected);
+            }
+        }
+    }
+
+    const uint64_t ten_ten = 10'000'000'000;
+    CHECK(multiplicative_order(3, ten_ten) == 500'000'000);
+    CHECK(multiplicative_order(7, ten_ten) == 50'000'000);
+    CHECK(multiplicative_order(2, ten_ten) == 0);
+
+    // lambda(10^18) = 2^16 5^17 is smooth, so this is a handful of tiny searches
+    const uint64_t ten_18 = 1'000'000'000'000'000'000ull;
+    const auto x = discrete_log(3, 991'797'645'005'156'643ull, ten_18);
+    REQUIRE(x.has_value());
+    CHECK(*x == 123'456'789'012'345ull % multiplicative_order(3, ten_18));
+    CHECK(pow_mod64(3, *x, ten_18) == 991'797'645'005'156'643ull);
+    CHECK(!discrete_log(3, 2, ten_18).has_value());
+    CHECK(discrete_log(10, 0, ten_18) == 18);
+
+    // p - 1 = 2 * 5^2 * 11 * 61 * 313 * 409 * 1073741827: one search of about 2^15 steps
+    const uint64_t p = 4'611'689'310'519'829'451ull;
+    const uint64_t y = 3'141'592'653'589'793'238ull;
+    const uint64_t g = 2;
+    const auto log = discrete_log(g, pow_mod64(g, y, p), p);
+    REQUIRE(log.has_value());
+    CHECK(pow_mod64(g, *log, p) == pow_mod64(g, y, p));
+    CHECK(*log < multiplicative_order(g, p));
+}
+
+TEST_CASE("Multi-limb integers") {
+    using U = UIntN<3>;
+    const U two_64 = U::power(2, 64);
+    CHECK(two_64.limb[1] == 1);
+    CHECK(two_64.bit_length() == 65);
+    CHECK(U::power(2, 128).to_string() == "340282366920938463463374607431768211456");
+    CHECK(U::power(10, 40).to_string() == "10000000000000000000000000000000000000000");
+    CHECK(U(42).to_string(5) == "00042");
+    CHECK(U(0).to_string() == "0");
+    CHECK((U::power(10, 40) - U(1)).to_string() == std::string(40, '9'));
+    CHECK(U::power(10, 40).low_bits(64).limb[1] == 0);
+    CHECK(U::power(10, 40).low_bits(70).limb[1] == (U::power(10, 40).limb[1] & 63));
+
+    // single limb agrees with pow_mod64
+    MontgomeryN<1> small(UIntN<1>(1'000'000'007));
+    CHECK(small.pow(UIntN<1>(3), 1'000'000).limb[0] == pow_mod64(3, 1'000'000, 1'000'000'007));
+
+    // 5^50 needs two limbs; check the result mod 5^27
+    MontgomeryN<2> five(UIntN<2>::power(5, 50));
+    auto x = five.pow(UIntN<2>(7), 12'345);
+    CHECK(x < five.modulus());
+    CHECK(UIntN<2>(x).divmod(7'450'580'596'923'828'125ull) == pow_mod64(7, 12'345, 7'450'580'596'923'828'125ull));
+    const uint64_t five_27 = 7'450'580'596'923'828'125ull;
+    uint64_t x_mod = 0;
+    for (size_t i = 2; i-- > 0;) {
+        x_mod = static_cast<uint64_t>(((u128{x_mod} << 64) | x.limb[i]) % five_27);
+    }
+    CHECK(x_mod == pow_mod64(7, 12'345, five_27));
+}
+
+TEST_CASE("Big integers") {
+    SmallVec<uint32_t, 4> v;
+    for (uint32_t i = 0; i < 10; i++) {
+        v.push_back(i);
+        CHECK(v.is_inline() == (i < 4));
+    }
+    SmallVec<uint32_t, 4> w = v;
+    CHECK(w == v);
+    CHECK(w[9] == 9);
+
+    const u128 x = u128{0xFFFF'FFFF'FFFF'FFFFull} * 0xFFFF'FFFF'FFFFull;
+    BigInt bx = BigInt(0xFFFF'FFFF'FFFF'FFFFull) * BigInt(0xFFFF'FFFF'FFFFull);
+    CHECK(bx.low_u64() == static_cast<uint64_t>(x));
+    CHECK(bx.bit_length() == 112);
+    CHECK(bx.to_string() == "5192296858534809181504947642957825");
+    CHECK(BigInt(0).to_string() == "0");
+    CHECK(BigInt::pow(2, 200).to_string() == "1606938044258990275541962092341162602522202993782792835301376");
+    CHECK(BigInt("1606938044258990275541962092341162602522202993782792835301376") == BigInt::pow(2, 200));
+    CHECK(BigInt::pow(2, 200) - BigInt(1) < BigInt::pow(2, 200));
+    CHECK(BigInt::pow(10, 40) / BigInt::pow(10, 25) == BigInt::pow(10, 15));
+    CHECK((BigInt::pow(10, 40) + BigInt(12'345)) % BigInt::pow(10, 25) == BigInt(12'345));
+
+    // 1000^1000 = 10^3000 exercises every multiplication method and the split conversion
+    const std::string power = BigInt::pow(1000, 1000).to_string();
+    CHECK(power.size() == 3001);
+    CHECK(power == "1" + std::string(3000, '0'));
+    const BigInt near = BigInt::pow(1000, 1000) - BigInt(1);
+    CHECK(near.to_string() == std::string(3000, '9'));
+    CHECK(BigInt(near.to_string()) == near);
+
+    // the three multiplications agree, and division undoes them
+    BigInt a = BigInt::pow(3, 60'000) + BigInt(17);
+    BigInt b = BigInt::pow(7, 30'000) + BigInt(5);
+    const BigInt product = BigInt::mul_ntt(a, b);
+    CHECK(BigInt::mul_karatsuba(a, b) == product);
+    CHECK(BigInt::mul_schoolbook(a, b) == product);
+    auto [q, r] = BigInt::divmod(product + BigInt(4), a);
+    CHECK(q == b);
+    CHECK(r == BigInt(4));
+}
+
+TEST_CASE("Digit signatures") {
+    CHECK(digit_signature(0) == 0);
+    CHECK(digit_signature(1487) == digit_signature(8147));
+    CHECK(digit_signature(1487) == digit_signature(4817));
+    CHECK(digit_signature(1487) != digit_signature(1478 + 1));
+    CHECK(digit_signature(100) == 0x2 + 0x10);
+    CHECK(digit_signature(10) != digit_signature(1));
+    CHECK(digit_signature(9'999'999'999) == uint64_t{10} << 36);
+    CHECK(signature_length(digit_signature(9'876'543'210)) == 10);
+    CHECK(signature_length(digit_signature(18'446'744'073'709'551'615ull)) == 20);
+    // a 4-bit count holds 15 repeats of a digit, not 16
+    CHECK(digit_signature_fits(111'111'111'111'111));
+    CHECK(digit_signature(111'111'111'111'111) == uint64_t{15} << 4);
+    CHECK(digit_signature_fits(2'111'111'111'111'111));
+    CHECK(digit_signature(2'111'111'111'111'111) == (uint64_t{15} << 4) + (uint64_t{1} << 8));
+    CHECK(!digit_signature_fits(1'111'111'111'111'111));
+    CHECK(!digit_signature_fits(10'000'000'000'000'000'000ull));
+    CHECK(!digit_signature_fits(3'111'111'111'111'111'112ull));
+    for (uint64_t n = 0; n < 100'000; n += 7) {
+        uint64_t slow = 0;
+        for (uint64_t m = n; m != 0; m /= 10) {
+            slow += uint64_t{1} << (4 * (m % 10));
+        }
+        CHECK(digit_signature(n) == slow);
+    }
+
+    std::vector<uint64_t> seen;
+    for_each_digit_permutation(digit_signature(1'003), [&](uint64_t n) { seen.push_back(n); });
+    CHECK(seen == std::vector<uint64_t>{1'003, 1'030, 1'300, 3'001, 3'010, 3'100});
+    seen.clear();
+    for_each_digit_permutation(digit_signature(1'223), [&](uint64_t n) { seen.push_back(n); });
+    CHECK(seen.size() == 12);
+    CHECK(std::is_sorted(seen.begin(), seen.end()));
+    int count = 0;
+    for_each_digit_permutation(0, [&](uint64_t) { count++; });
+    CHECK(count == 0);
+}
+
+TEST_CASE("Arithmetic progressions") {
+    // 1..20 holds 20 - (k - 1) d progressions of each difference d
+    std::vector<uint64_t> run(20);
+    std::iota(run.begin(), run.end(), 1);
+    for (const int k : {3, 4, 5}) {
+        uint64_t expected = 0;
+        for (uint64_t d = 1; (k - 1) * d < 20; d++) {
+            expected += 20 - (k - 1) * d;
+        }
+        ApDetector detector(k);
+        CHECK(detector.find(run, [](uint64_t, uint64_t) {}) == expected);
+    }
+
+    // agrees with brute force on scattered sets, reusing one detector per k
+    ApDetector three(3), four(4), five(5);
+    uint64_t state = 12'345;
+    for (int trial = 0; trial < 10; trial++) {
+        std::vector<uint64_t> set;
+        for (uint64_t x = 0; x < 400; x++) {
+            state = state * 6'364'136'223'846'793'005ull + 1'442'695'040'888'963'407ull;
+            if ((state >> 60) < 5) {
+                set.push_back(x);
+            }
+        }
+        for (ApDetector *detector : {&three, &four, &five}) {
+            const int k = detector->terms();
+            std::vector<std::pair<uint64_t, uint64_t>> brute;
+            for (const uint64_t a : set) {
+                for (uint64_t d = 1; a + (k - 1) * d <= set.back(); d++) {
+                    bool all = true;
+                    for (int t = 1; t < k && all; t++) {
+                        all = std::binary_search(set.begin(), set.end(), a + t * d);
+                    }
+                    if (all) {
+                        brute.emplace_back(a, d);
+                    }
+                }
+            }
+            std::vector<std::pair<uint64_t, uint64_t>> found;
+            detector->find(set, [&](uint64_t a, uint64_t d) { found.emplace_back(a, d); });
+            std::sort(found.begin(), found.end());
+            CHECK(found == brute);
+        }
+    }
+}
+
+TEST_CASE("Packed BCD") {
+    CHECK(to_bcd(0) == 0);
+    CHECK(to_bcd(56'003) == 0x56'003);
+    CHECK(to_bcd(9'876'543'210'123'456ull) == 0x9'876'543'210'123'456ull);
+    CHECK(from_bcd(0x9'876'543'210'123'456ull) == 9'876'543'210'123'456ull);
+    CHECK(bcd_digit_count(to_bcd(56'003)) == 5);
+    CHECK(bcd_digit_count(to_bcd(1'000'000'000)) == 10);
+    CHECK(bcd_digit_count(0) == 0);
+
+    const uint64_t x = to_bcd(56'003);
+    CHECK(bcd_digit_positions(x, 5, 0) == 0x00'110);
+    CHECK(bcd_digit_positions(x, 8, 0) == 0x1'1100'110);     // leading zeros count inside the range
+    CHECK(bcd_digit_frequency(x, 5, 3) == 1);
+    CHECK(from_bcd(bcd_replace(x, bcd_digit_positions(x, 5, 0), 7)) == 56'773);
+
+    for (uint64_t n = 1; n < 200'000; n += 13) {
+        CHECK(from_bcd(to_bcd(n)) == n);
+        CHECK(bcd_signature(to_bcd(n)) == digit_signature(n));
+    }
+
+    const PrimeTable table(1'000'000 - 5'000, 3'100'000, true, 3);
+    const auto sieve = prime_bitmap(3'100'000);
+    uint64_t expected = 0;
+    for (uint64_t n = 995'000; n < 3'100'000; n++) {
+        expected += sieve.test(n);
+    }
+    CHECK(table.size() == expected);
+    CHECK(table.primes().front() == 995'009);
+    for (size_t i = 0; i < table.size(); i += 97) {
+        CHECK(sieve.test(table.primes()[i]));
+        CHECK(from_bcd(table.bcd()[i]) == table.primes()[i]);
+    }
+}
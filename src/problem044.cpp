@@ -2,6 +2,9 @@
 #include <ranges>
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
 #define DOCTEST_CONFIG_IMPLEMENT
 #include "doctest.h"
@@ -136,6 +139,127 @@ TEST_CASE("Pentagonals") {
 
 */
 
+// Exact pentagonal test for values too large for the sqrt/fmod shortcut above
+bool is_pentagonal_exact(const int64_t p) {
+    const int64_t x = 1 + 24 * p;
+    auto r = static_cast<int64_t>(std::sqrt(static_cast<double>(x)));
+    while (r * r > x) {
+        r--;
+    }
+    while ((r + 1) * (r + 1) <= x) {
+        r++;
+    }
+    return r * r == x && r % 6 == 5;
+}
+
+// Prime factorization as (prime, exponent) pairs, by trial division
+std::vector<std::pair<int64_t, int>> factor_pairs(int64_t n) {
+    std::vector<std::pair<int64_t, int>> factors;
+    for (int64_t f = 2; f * f <= n; f += (f == 2 ? 1 : 2)) {
+        int e = 0;
+        while (n % f == 0) {
+            n /= f;
+            e++;
+        }
+        if (e > 0) {
+            factors.emplace_back(f, e);
+        }
+    }
+    if (n > 1) {
+        factors.emplace_back(n, 1);
+    }
+    return factors;
+}
+
+// All divisors of 2 * P_m = m (3m - 1).
+// gcd(m, 3m - 1) = 1, so the factorization of 2 P_m is just the union of the factorizations of m and 3m - 1.
+std::vector<int64_t> divisors_of_twice_pentagonal(const int64_t m) {
+    auto factors = factor_pairs(m);
+    auto other = factor_pairs(3 * m - 1);
+    factors.insert(factors.end(), other.begin(), other.end());
+
+    std::vector<int64_t> divisors{1};
+    for (const auto& [p, e] : factors) {
+        const size_t count = divisors.size();
+        int64_t pk = 1;
+        for (int i = 0; i < e; i++) {
+            pk *= p;
+            for (size_t d = 0; d < count; d++) {
+                divisors.push_back(divisors[d] * pk);
+            }
+        }
+    }
+    return divisors;
+}
+
+struct PentagonalPair {
+    int64_t D = 0;      // P_k - P_j
+    int64_t S = 0;      // P_k + P_j
+    int64_t j = 0;
+    int64_t k = 0;
+    int64_t m = 0;      // D = P_m
+    int64_t pairs_checked = 0;
+};
+
+// Visit pentagonal D = P_m in increasing m. From the derivation above, 2D = l (6j + 3l - 1),
+// so every (j, l) with P_{j+l} - P_j = D comes from a divisor l of 2D with
+// 2D / l - 3l + 1 divisible by 6 and positive. Only those pairs have S checked.
+// The first hit is the minimal D: every smaller pentagonal D has already had all of its pairs rejected.
+PentagonalPair smallest_pentagonal_pair(const int64_t max_m) {
+    PentagonalPair result;
+    for (int64_t m = 1; m <= max_m; m++) {
+        const int64_t D = m * (3*m - 1) / 2;
+        const int64_t D2 = 2 * D;
+        for (const int64_t l : divisors_of_twice_pentagonal(m)) {
+            const int64_t r = D2 / l - 3*l + 1;
+            if (r <= 0 || r % 6 != 0) {
+                continue;
+            }
+            result.pairs_checked++;
+            const int64_t j = r / 6;
+            const int64_t k = j + l;
+            const int64_t S = j * (3*j - 1) / 2 + k * (3*k - 1) / 2;
+            if (is_pentagonal_exact(S) && (result.m == 0 || j < result.j)) {
+                result.D = D;
+                result.S = S;
+                result.j = j;
+                result.k = k;
+                result.m = m;
+            }
+        }
+        if (result.m != 0) {
+            break;
+        }
+    }
+    return result;
+}
+
+TEST_CASE("Pentagonal differences") {
+    CHECK(is_pentagonal_exact(1));
+    CHECK(is_pentagonal_exact(5482660));
+    CHECK(!is_pentagonal_exact(5482661));
+
+    CHECK(divisors_of_twice_pentagonal(4).size() == 6); // 2 P_4 = 44 = 2^2 * 11
+
+    // every recovered (j, l) pair must reproduce D
+    for (int64_t m = 1; m < 200; m++) {
+        const int64_t D = m * (3*m - 1) / 2;
+        for (const int64_t l : divisors_of_twice_pentagonal(m)) {
+            const int64_t r = 2*D / l - 3*l + 1;
+            if (r > 0 && r % 6 == 0) {
+                const int64_t j = r / 6;
+                const int64_t k = j + l;
+                CHECK(k * (3*k - 1) / 2 - j * (3*j - 1) / 2 == D);
+            }
+        }
+    }
+
+    auto pair = smallest_pentagonal_pair(2'000);
+    CHECK(pair.D == 5482660);
+    CHECK(pair.j == 1020);
+    CHECK(pair.k == 2167);
+}
+
 int main(int argc, char** argv) {
 
     doctest::Context ctx;
@@ -152,44 +276,17 @@ int main(int argc, char** argv) {
     // propagate the result of the tests
         return res;
 
-    const int MAX_N = 5'000;
+    // upper bound on the index of D only, the search stops at the first hit
+    const int64_t MAX_M = 1'000'000;
     
     auto start = std::chrono::high_resolution_clock::now();
 
-    int smallest_difference = pentagonal2(MAX_N);
-    int best_k = 0;
-    int best_j = 0;
-    int min_diff = MAX_N;
-
-    std::vector<int> pentagonals(MAX_N);
-    pentagonals[0] = 1;
-
-    // brute force option
-    for (int k = 2; k <= MAX_N; k++) {
-        int Pk = pentagonal2(k);
-        pentagonals[k - 1] = Pk;
-        for (int j = k - 1; j > 0; j--) {
-            int Pj = pentagonals[j-1];
-            int D = Pk - Pj;
-            if (D > smallest_difference) {
-                min_diff = std::min(min_diff, k - j);
-                break;
-            }
-            if (is_pentagonal2(D)) {
-                int S = Pk + Pj;
-                if (is_pentagonal2(S)) {
-                    smallest_difference = std::min(smallest_difference, D);
-                    best_k = k;
-                    best_j = j;
-                }
-            }
-        }
-        if (min_diff == 1) {
-            break;
-        }
-    }
+    auto pair = smallest_pentagonal_pair(MAX_M);
 
-    std::cout << smallest_difference / 2 << ", " << best_k << ", " << best_j << std::endl;
+    std::cout << pair.D << ", " << pair.k << ", " << pair.j << std::endl;
+    std::cout << "D = P(" << pair.m << "), S = " << pair.S << std::endl;
+    std::cout << "Certificate: all " << pair.pairs_checked << " (j, k) pairs with pentagonal D <= P("
+              << pair.m << ") checked, none with D < P(" << pair.m << ")" << std::endl;
 
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
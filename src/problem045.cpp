@@ -29,12 +29,15 @@ int main(int argc, char** argv) {
     // observation 2: all hexagonal numbers are pentagonal
     auto start = high_resolution_clock::now();
 
+    // every hexagonal number we test is below H(N_MAX)
+    FigurateIndex<5> pentagonals(polygonal<6>(static_cast<uint64_t>(N_MAX)));
+
     int64_t answer = -1;
     int index = -1;
 
     for (int i = N_MIN; i <= N_MAX; i++) {
         auto H = hexagonal<int64_t>(i);
-        if (is_pentagonal(H)) {
+        if (pentagonals.contains(H)) {
             answer = H;
             index = i;
             break;
@@ -2,9 +2,209 @@
 #include "doctest.h"
 #include "common.h"
 
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
 using namespace std::chrono;
 
+// Smallest odd composite below N that is not p + 2k^2, by trial division of every candidate p
+int first_counterexample_trial_division(int N) {
+    for (int i = 3; i < N; i += 2) {
+        if (is_prime(i)) {
+            continue;
+        }
+        auto j = 1;
+        auto none_found = true;
+        int p = i - 2*j*j;
+        while (p > 0) {
+            if (is_prime(p)) {
+                none_found = false;
+                break;
+            }
+            j += 1;
+            p = i - 2 * j * j;
+        }
+        if (none_found) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint64_t twice_square(uint64_t k) {
+    return 2 * k * k;
+}
+
+uint32_t ways_naive(uint64_t n, uint64_t K) {
+    uint32_t ways = 0;
+    for (uint64_t k = 1; k <= K && twice_square(k) < n; k++) {
+        ways += is_prime_u64(n - twice_square(k));
+    }
+    return ways;
+}
+
+// ways[n] = number of (p, k), p prime and k >= 1, with p + 2k^2 = n, for every n < N.
+// This is the convolution of the prime indicator with the 2k^2 indicator. Every count is at most sqrt(N / 2),
+// far below the NTT prime, so one modulus already gives exact counts.
+std::vector<uint32_t> representation_counts(const uint64_t N, unsigned threads = 0) {
+    const auto primes = prime_bitmap(N);
+    std::vector<uint32_t> prime_indicator(N);
+    for (uint64_t i = 0; i < N; i++) {
+        prime_indicator[i] = primes.test(i);
+    }
+    // ends at the largest 2k^2 < N; that is close to N, so the full product is still about 2N long
+    uint64_t k_max = 0;
+    while (twice_square(k_max + 1) < N) {
+        k_max++;
+    }
+    std::vector<uint32_t> square_indicator(twice_square(k_max) + 1);
+    for (uint64_t k = 1; k <= k_max; k++) {
+        square_indicator[twice_square(k)] = 1;
+    }
+    return convolve_mod<NTT_PRIME_1, NTT_ROOT_1>(prime_indicator, square_indicator, N, threads);
+}
+
+struct BlockReport {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint32_t min_ways = 0;          // fewest representations with k <= K among the block's odd composites
+    uint64_t min_ways_at = 0;
+    uint64_t hardest_k = 0;         // largest smallest k any odd composite in the block needs
+    uint64_t hardest_at = 0;
+    std::vector<uint64_t> counterexamples;
+};
+
+// Checks every odd composite n in [lo, hi) for a representation n = p + 2k^2.
+// Blocks are handed out to threads one at a time. Each block sieves only [block_lo - 2K^2, block_hi)
+// from the base primes up to sqrt(hi) and counts representations with k <= K from that window.
+// The rare n with none are retried for k > K with Miller-Rabin before being reported as counterexamples.
+// Finished blocks are written to out (if given) as soon as they complete, in completion order.
+std::vector<BlockReport> verify_range(const uint64_t lo, const uint64_t hi, const uint64_t K, const uint64_t block_size,
+                                      std::ostream *out = nullptr, unsigned threads = 0) {
+    const uint64_t window = twice_square(K);
+    const uint64_t num_blocks = hi > lo ? (hi - lo + block_size - 1) / block_size : 0;
+
+    std::vector<uint64_t> base_primes;
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(hi))) + 1;
+    const auto small = prime_bitmap(root);
+    for (uint64_t i = 2; i <= root; i++) {
+        if (small.test(i)) {
+            base_primes.push_back(i);
+        }
+    }
+
+    std::vector<BlockReport> reports(num_blocks);
+    std::atomic<uint64_t> next_block{0};
+    std::mutex out_mutex;
+
+    auto worker = [&] {
+        for (uint64_t b = next_block++; b < num_blocks; b = next_block++) {
+            BlockReport &report = reports[b];
+            report.lo = lo + b * block_size;
+            report.hi = std::min(hi, report.lo + block_size);
+            report.min_ways = UINT32_MAX;
+
+            const uint64_t w_lo = report.lo > window ? report.lo - window : 0;
+            const auto sieve = segmented_prime_bitmap(w_lo, report.hi, base_primes);
+
+            for (uint64_t n = report.lo | 1; n < report.hi; n += 2) {
+                if (n < 9 || sieve.test(n - w_lo)) {
+                    continue;
+                }
+                uint32_t ways = 0;
+                uint64_t first_k = 0;
+                for (uint64_t k = 1; k <= K && twice_square(k) < n; k++) {
+                    if (sieve.test(n - twice_square(k) - w_lo)) {
+                        ways++;
+                        first_k = first_k == 0 ? k : first_k;
+                    }
+                }
+                if (ways < report.min_ways) {
+                    report.min_ways = ways;
+                    report.min_ways_at = n;
+                }
+                if (ways == 0) {
+                    for (uint64_t k = K + 1; twice_square(k) < n; k++) {
+                        if (is_prime_u64(n - twice_square(k))) {
+                            first_k = k;
+                            break;
+                        }
+                    }
+                    if (first_k == 0) {
+                        report.counterexamples.push_back(n);
+                    }
+                }
+                if (first_k > report.hardest_k) {
+                    report.hardest_k = first_k;
+                    report.hardest_at = n;
+                }
+            }
+
+            if (out != nullptr) {
+                std::lock_guard<std::mutex> lock(out_mutex);
+                *out << report.lo << " " << report.hi << " " << report.min_ways << " " << report.min_ways_at
+                     << " " << report.hardest_k << " " << report.hardest_at;
+                for (const uint64_t n : report.counterexamples) {
+                    *out << " " << n;
+                }
+                *out << std::endl;
+            }
+        }
+    };
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+    return reports;
+}
+
+TEST_CASE("Goldbach's other conjecture") {
+    CHECK(first_counterexample_trial_division(10'000) == 5777);
+
+    // several blocks of words, split over threads
+    auto counterexamples = uncovered_odd_composites(prime_bitmap(1'000'000), 1'000'000, twice_square, 4);
+    CHECK(counterexamples == std::vector<uint64_t>{5777, 5993});
+
+    const int N = 3'000;
+    auto ways = representation_counts(N);
+    for (int n = 1; n < N; n++) {
+        uint32_t expected = 0;
+        for (int k = 1; 2*k*k < n; k++) {
+            expected += is_prime(n - 2*k*k);
+        }
+        CHECK(ways[n] == expected);
+    }
+
+    // K = 3 leaves plenty of n without a short representation, which must fall back to Miller-Rabin
+    std::ostringstream log;
+    auto reports = verify_range(1, 100'000, 3, 4'096, &log, 3);
+    std::vector<uint64_t> found;
+    for (const auto &report : reports) {
+        found.insert(found.end(), report.counterexamples.begin(), report.counterexamples.end());
+    }
+    CHECK(found == std::vector<uint64_t>{5777, 5993});
+    const std::string lines = log.str();
+    CHECK(std::count(lines.begin(), lines.end(), '\n') == static_cast<long>(reports.size()));
+
+    auto wide = verify_range(1'000'000, 1'100'000, 100, 16'384, nullptr, 2);
+    for (const auto &report : wide) {
+        CHECK(report.counterexamples.empty());
+        CHECK(report.min_ways == ways_naive(report.min_ways_at, 100));
+        CHECK(ways_naive(report.hardest_at, report.hardest_k) == 1);
+        CHECK(ways_naive(report.hardest_at, report.hardest_k - 1) == 0);
+    }
+}
+
 int main(int argc, char** argv) {
 
     doctest::Context ctx;
@@ -21,34 +221,54 @@ int main(int argc, char** argv) {
     // propagate the result of the tests
         return res;
 
+    // problem046 verify <lo> <hi> <results file> [K] [block size]
+    if (argc >= 5 && std::string(argv[1]) == "verify") {
+        const uint64_t lo = std::stoull(argv[2]);
+        const uint64_t hi = std::stoull(argv[3]);
+        const uint64_t K = argc >= 6 ? std::stoull(argv[5]) : 128;
+        const uint64_t block_size = argc >= 7 ? std::stoull(argv[6]) : uint64_t{1} << 22;
+        std::ofstream results(argv[4]);
+
+        auto start = high_resolution_clock::now();
+        auto reports = verify_range(lo, hi, K, block_size, &results);
+        uint64_t counterexamples = 0;
+        uint32_t min_ways = UINT32_MAX;
+        uint64_t hardest_k = 0;
+        for (const auto &report : reports) {
+            counterexamples += report.counterexamples.size();
+            min_ways = std::min(min_ways, report.min_ways);
+            hardest_k = std::max(hardest_k, report.hardest_k);
+        }
+        auto stop = high_resolution_clock::now();
+
+        std::cout << "Blocks: " << reports.size() << ", counterexamples: " << counterexamples
+                  << ", fewest representations (k <= " << K << "): " << min_ways
+                  << ", largest k needed: " << hardest_k << std::endl;
+        std::cout << "Took " << duration_cast<std::chrono::milliseconds>(stop - start).count() << " ms" << std::endl;
+        return 0;
+    }
+
     auto start = high_resolution_clock::now();
     
-    // CODE GOES HERE
     int N = 10'000;
     int answer = -1;
-       
-    for (int i = 3; i < N; i += 2) {
-        if (is_prime(i)) {
-            continue;
-        }
-        auto j = 1;
-        auto none_found = true;
-        int p = i - 2*j*j;
-        while (p > 0) {
-            if (is_prime(p)) {
-                none_found = false;
-                break;
-            }
-            j += 1;
-            p = i - 2 * j * j;
-        }
-        if (none_found) {
-            answer = i;
-            break;
-        }
+
+    auto counterexamples = uncovered_odd_composites(prime_bitmap(N), N, twice_square);
+    if (!counterexamples.empty()) {
+        answer = counterexamples[0];
     }
 
     std::cout<< "Answer: " << answer << std::endl;
+
+    // the conjecture only barely holds for odd composites with a single representation
+    auto ways = representation_counts(N);
+    int last_single = -1;
+    for (int i = 9; i < N; i += 2) {
+        if (!is_prime(i) && ways[i] == 1) {
+            last_single = i;
+        }
+    }
+    std::cout << "Largest with one representation: " << last_single << std::endl;
     
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<std::chrono::microseconds>(stop - start);
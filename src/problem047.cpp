@@ -5,6 +5,72 @@
 #include <chrono>
 using namespace std::chrono;
 
+// out[i] = number of distinct prime factors of lo + i, for every n in [lo, hi).
+// Sieves the block with base_primes (all primes up to sqrt(hi)) and divides them out of a copy of each n,
+// so anything left over above 1 is one last prime factor.
+void distinct_prime_factor_counts(const uint64_t lo, const uint64_t hi, const std::vector<uint64_t> &base_primes, uint8_t *out) {
+    thread_local std::vector<uint64_t> rest;
+    rest.resize(hi - lo);
+    for (uint64_t n = lo; n < hi; n++) {
+        rest[n - lo] = n;
+        out[n - lo] = 0;
+    }
+    for (const uint64_t p : base_primes) {
+        if (p * p >= hi) {
+            break;
+        }
+        for (uint64_t n = (lo + p - 1) / p * p; n < hi; n += p) {
+            out[n - lo]++;
+            do {
+                rest[n - lo] /= p;
+            } while (rest[n - lo] % p == 0);
+        }
+    }
+    for (uint64_t n = lo; n < hi; n++) {
+        out[n - lo] += rest[n - lo] > 1;
+    }
+}
+
+std::vector<uint64_t> primes_up_to(const uint64_t n) {
+    const auto sieve = prime_bitmap(n);
+    std::vector<uint64_t> p;
+    for (uint64_t i = 2; i <= n; i++) {
+        if (sieve.test(i)) {
+            p.push_back(i);
+        }
+    }
+    return p;
+}
+
+TEST_CASE("Distinct prime factors") {
+    const auto base = primes_up_to(100);
+    std::vector<uint8_t> omega(10'000);
+    distinct_prime_factor_counts(1, 10'001, base, omega.data());
+    for (int n = 1; n <= 10'000; n++) {
+        int expected = 0;
+        int m = n;
+        for (int f = 2; f <= m; f++) {
+            if (m % f == 0) {
+                expected++;
+                while (m % f == 0) {
+                    m /= f;
+                }
+            }
+        }
+        CHECK(omega[n - 1] == expected);
+    }
+
+    auto four_factors = [&](uint64_t lo, uint64_t hi, uint8_t *out) {
+        distinct_prime_factor_counts(lo, hi, base, out);
+        for (uint64_t i = 0; i < hi - lo; i++) {
+            out[i] = out[i] == 3;
+        }
+    };
+    auto runs = find_runs(2, 10'000, four_factors, 3, RunMode::First);
+    REQUIRE(runs.size() == 1);
+    CHECK(runs[0].start == 644);
+}
+
 int main(int argc, char** argv) {
 
     doctest::Context ctx;
@@ -27,21 +93,17 @@ int main(int argc, char** argv) {
     int answer = -1;
     int N = 1'000'000;
     int RUN_SIZE = 4;
-    for (int i = 2; i < N; i++) {
-        bool failed = false;
-        auto m = num_prime_factors(i); 
-        if (m == RUN_SIZE) {
-            for (int j = 1; j < RUN_SIZE; j++) {
-                if (num_prime_factors(i+j) != RUN_SIZE){
-                    failed = true;
-                    break;
-                }
-            }
-            if (!failed) {
-                answer = i;
-                break;
-            }
+
+    const auto base_primes = primes_up_to(static_cast<uint64_t>(std::sqrt(N)) + 1);
+    auto has_run_size_factors = [&](uint64_t lo, uint64_t hi, uint8_t *out) {
+        distinct_prime_factor_counts(lo, hi, base_primes, out);
+        for (uint64_t i = 0; i < hi - lo; i++) {
+            out[i] = out[i] == RUN_SIZE;
         }
+    };
+    auto runs = find_runs(2, N, has_run_size_factors, RUN_SIZE, RunMode::First);
+    if (!runs.empty()) {
+        answer = runs[0].start;
     }
 
     std::cout << "Answer: " << answer << std::endl;
@@ -5,6 +5,10 @@
 #include <chrono>
 using namespace std::chrono;
 
+#include <cctype>
+#include <numeric>
+#include <mutex>
+#include <string>
 #include <vector>
 
 
@@ -29,42 +33,212 @@ uint64_t binary_log(const uint64_t n) {
 
 // find a * b % n
 uint64_t mul_mod_n(uint64_t a, uint64_t b, uint64_t n) {
-    uint64_t res = 0;
-    a %= n;
-    while (b) {
-        if (b & 1)
-            res = (res + a) % n;
-        b >>= 1;
-        a = (a << 1) % n;
+    return mul_mod64(a % n, b % n, n);
+}
+
+// Find a^b mod n by repeated squaring, with Barrett reduction instead of a division per step
+uint64_t pow_mod_n(uint64_t a, uint64_t b, uint64_t n) {
+    return Barrett64(n).pow(a, b);
+}
+
+// 1^1 + 2^2 + ... + n^n mod the CRT modulus, summed separately in every prime-power part
+uint64_t self_power_sum(const uint64_t n, const CrtModulus &mod) {
+    const auto &parts = mod.parts();
+    std::vector<uint64_t> sums(parts.size(), 0);
+    for (uint64_t i = 1; i <= n; i++) {
+        for (size_t j = 0; j < parts.size(); j++) {
+            sums[j] = add_mod64(sums[j], mod.pow_part(j, i, i), parts[j].q);
+        }
     }
+    return mod.combine(sums);
+}
 
-    return res;
+// 1^1 + 2^2 + ... + n^n mod m, exponentiating a batch of consecutive i at a time
+uint64_t self_power_sum_batched(const uint64_t n, const uint64_t m) {
+    const uint64_t batch = 1024;
+    std::vector<uint64_t> bases;
+    uint64_t sum = 0;
+    for (uint64_t lo = 1; lo <= n; lo += batch) {
+        bases.clear();
+        for (uint64_t i = lo; i <= std::min(n, lo + batch - 1); i++) {
+            bases.push_back(i);
+        }
+        for (const uint64_t p : pow_mod_batch(bases, bases, m)) {
+            sum = add_mod64(sum, p, m);
+        }
+    }
+    return sum;
 }
 
-// Find a^b mod n by repeated squaring
-uint64_t pow_mod_n(uint64_t a, uint64_t b, uint64_t n) {
+// sum of i^i mod q = p^e for lo <= i < hi, with i split across threads.
+//  - when p divides i and i >= e, p^e divides i^i, so the term vanishes and is never computed
+//  - otherwise i is a unit mod p^e and the exponent can be taken mod lambda(p^e)
+//    (only 8 bits instead of 30 for 2^10 at n = 1e9)
+// Every thread keeps its own partial sum, merged once at the end.
+uint64_t part_self_power_sum(const CrtModulus::Part &part, const uint64_t lo, const uint64_t hi, unsigned threads = 0) {
+    const uint64_t lambda = carmichael_lambda_prime_power(part.p, part.e);
+    uint64_t sum = 0;
+    std::mutex sum_mutex;
+    parallel_for(lo, hi, [&](uint64_t c_lo, uint64_t c_hi) {
+        const uint64_t batch = 1024;
+        uint64_t partial = 0;
+        std::vector<uint64_t> bases;
+        std::vector<uint64_t> exps;
+        for (uint64_t b_lo = c_lo; b_lo < c_hi; b_lo += batch) {
+            bases.clear();
+            exps.clear();
+            for (uint64_t i = b_lo; i < std::min(c_hi, b_lo + batch); i++) {
+                if (i % part.p != 0) {
+                    bases.push_back(i % part.q);
+                    exps.push_back(i % lambda);
+                } else if (i < static_cast<uint64_t>(part.e)) {
+                    bases.push_back(i % part.q);
+                    exps.push_back(i);
+                }
+            }
+            // reduced per term: a batch of residues near a large q would overflow 64 bits
+            for (const uint64_t x : pow_mod_batch(bases, exps, part.q)) {
+                partial = add_mod64(partial, x, part.q);
+            }
+        }
+        std::lock_guard<std::mutex> lock(sum_mutex);
+        sum = add_mod64(sum, partial, part.q);
+    }, threads);
+    return sum;
+}
 
-    // a^b = a^(c0 + c1*2 + c2*2^2 + c3*2^3 + ...), ci = 0 or 1
-    // a^b = prod_{c_i != 0} a^2^i
-    uint64_t acc = 1;
-    uint64_t exponent = a;
+// 1^1 + 2^2 + ... + n^n mod m, each prime power part of m summed on its own and recombined by CRT
+uint64_t self_power_sum_parallel(const uint64_t n, const uint64_t m, unsigned threads = 0) {
+    const CrtModulus mod(m);
+    std::vector<uint64_t> sums;
+    for (const auto &part : mod.parts()) {
+        sums.push_back(part_self_power_sum(part, 1, n + 1, threads));
+    }
+    return mod.combine(sums);
+}
 
-    while (b > 0) {
-    
-        // check if the i-th digit of n is 1
-        if (b & 1) {
-            // if so, then multiply the present exponent with our accumulator (mod 10^m)
-            acc = mul_mod_n(acc, exponent, n);
+// For i >= e, i^i mod p^e only depends on i mod p^e (the base, and whether p divides it)
+// and on i mod lambda(p^e) (the exponent), so the terms repeat with period lcm(p^e, lambda(p^e))
+// after a pre-period of e - 1 terms.
+struct PartPeriod {
+    uint64_t pre_period;
+    uint64_t period;
+};
+
+// lcm(a, b), or 2^64 - 1 when it does not fit; no 64-bit n ever completes such a period
+uint64_t saturating_lcm(const uint64_t a, const uint64_t b) {
+    const unsigned __int128 l = static_cast<unsigned __int128>(a / std::gcd(a, b)) * b;
+    return l > UINT64_MAX ? UINT64_MAX : static_cast<uint64_t>(l);
+}
+
+PartPeriod part_period(const CrtModulus::Part &part) {
+    const uint64_t lambda = carmichael_lambda_prime_power(part.p, part.e);
+    return PartPeriod{static_cast<uint64_t>(part.e - 1), saturating_lcm(part.q, lambda)};
+}
+
+// Pre-period and period of i^i mod m as a whole
+PartPeriod self_power_period(const uint64_t m) {
+    PartPeriod whole{0, 1};
+    const CrtModulus mod(m);
+    for (const auto &part : mod.parts()) {
+        const auto [pre_period, period] = part_period(part);
+        whole.pre_period = std::max(whole.pre_period, pre_period);
+        whole.period = saturating_lcm(whole.period, period);
+    }
+    return whole;
+}
+
+// 1^1 + 2^2 + ... + n^n mod m for any 64-bit n. Per prime power part the sum is
+// pre-period + (full periods) * (one period's sum) + (leftover terms), so the cost is one
+// period of exponentiations per part no matter how large n is (4 * 5^10 terms for 10^10).
+uint64_t self_power_sum_periodic(const uint64_t n, const uint64_t m, unsigned threads = 0) {
+    const CrtModulus mod(m);
+    std::vector<uint64_t> sums;
+    for (const auto &part : mod.parts()) {
+        const auto [pre_period, period] = part_period(part);
+        const uint64_t start = pre_period + 1;
+        uint64_t sum = part_self_power_sum(part, 1, std::min(n, pre_period) + 1, threads);
+        if (n >= start) {
+            const uint64_t terms = n - pre_period;
+            const uint64_t full = terms / period;
+            const uint64_t leftover = part_self_power_sum(part, start, start + terms % period, threads);
+            uint64_t cycle = 0;
+            if (full > 0) {
+                cycle = add_mod64(leftover, part_self_power_sum(part, start + terms % period, start + period, threads), part.q);
+            }
+            sum = add_mod64(add_mod64(sum, mul_mod64(full % part.q, cycle, part.q), part.q), leftover, part.q);
         }
+        sums.push_back(sum);
+    }
+    return mod.combine(sums);
+}
 
-        // square the exponent
-        exponent = mul_mod_n(exponent, exponent, n);
+// The direct sum pays n terms per part and the periodic one about one period (plus pre-period)
+// per part, so the periodic sum is cheaper once n passes the parts' periods added up.
+bool periodic_sum_is_cheaper(const uint64_t n, const uint64_t m) {
+    const CrtModulus mod(m);
+    unsigned __int128 periodic_terms = 0;
+    for (const auto &part : mod.parts()) {
+        const auto [pre_period, period] = part_period(part);
+        periodic_terms += pre_period + static_cast<unsigned __int128>(period);
+    }
+    return n >= periodic_terms;
+}
+
+// 1^1 + 2^2 + ... + n^n mod m by whichever of the two sums is cheaper for this n
+uint64_t self_power_sum_fastest(const uint64_t n, const uint64_t m, unsigned threads = 0) {
+    return periodic_sum_is_cheaper(n, m) ? self_power_sum_periodic(n, m, threads) : self_power_sum_parallel(n, m, threads);
+}
 
-        // Shift n0 one bit to the right
-        b >>= 1;
+// Last k decimal digits of 1^1 + 2^2 + ... + n^n as a zero-padded string, for k too large for
+// 64-bit arithmetic. 10^k is even, so Montgomery form cannot be used directly: the sum is taken
+// mod 2^k with truncated products and mod 5^k with MontgomeryN, then the two are recombined.
+// UIntN<Limbs> must hold 10^k, i.e. 64 * Limbs > 3.33 * k.
+template <size_t Limbs>
+std::string self_power_sum_last_digits(const uint64_t n, const int k) {
+    using Int = UIntN<Limbs>;
+    assert(k > 0 && 64.0 * Limbs > k * 3.3219280948873626);
+
+    const Int five_k = Int::power(5, k);
+    const MontgomeryN<Limbs> mod_five(five_k);
+
+    Int sum_two(0), sum_five(0);
+    for (uint64_t i = 1; i <= n; i++) {
+        // i^i vanishes mod 2^k for even i >= k, and mod 5^k for multiples of 5 with i >= k
+        if (i % 2 == 1 || i < static_cast<uint64_t>(k)) {
+            Int acc(1), base(i);
+            for (uint64_t e = i; e > 0; e >>= 1) {
+                if (e & 1) {
+                    acc = mul_lo(acc, base).low_bits(k);
+                }
+                base = mul_lo(base, base).low_bits(k);
+            }
+            sum_two = (sum_two + acc).low_bits(k);
+        }
+        if (i % 5 != 0 || i < static_cast<uint64_t>(k)) {
+            sum_five = sum_five + mod_five.pow(Int(i), i);
+            if (!(sum_five < five_k)) {
+                sum_five = sum_five - five_k;
+            }
+        }
+    }
+
+    // 5^-k mod 2^(64 Limbs) by Newton iteration, each step doubles the correct low bits
+    Int inv = five_k;
+    for (size_t bits = 3; bits < 64 * Limbs; bits *= 2) {
+        inv = mul_lo(inv, Int(2) - mul_lo(five_k, inv));
     }
+    const Int t = mul_lo(sum_two - sum_five, inv).low_bits(k);
+    return (sum_five + mul_lo(five_k, t)).to_string(k);
+}
 
-    return acc;
+// 1^1 + 2^2 + ... + n^n in full
+BigInt self_power_sum_exact(const uint64_t n) {
+    BigInt sum;
+    for (uint64_t i = 1; i <= n; i++) {
+        sum += BigInt::pow(i, i);
+    }
+    return sum;
 }
 
 TEST_CASE("powers of two") {
@@ -97,6 +271,64 @@ TEST_CASE("powers of two") {
     CHECK(pow_mod_n(31, 31, ten_ten) == 6044734431);
     CHECK(pow_mod_n(51, 51, ten_ten) == 8231315051);
     CHECK(pow_mod_n(99, 99, ten_ten) == 9200499899);
+    CHECK(mul_mod_n(ten_ten - 1, ten_ten - 1, ten_ten) == 1);
+    CHECK(ModInt<ten_ten>(99).pow(99).value() == 9200499899);
+
+    // 10^10 = 2^10 * 5^10
+    CrtModulus digits({{2, 10}, {5, 10}});
+    CHECK(digits.pow(99, 99) == 9200499899);
+    CHECK(self_power_sum(10, digits) == 405071317);
+    CHECK(self_power_sum_batched(10, ten_ten) == 405071317);
+    CHECK(self_power_sum_batched(3'000, ten_ten) == self_power_sum(3'000, digits));
+    CHECK(self_power_sum_parallel(10, ten_ten) == 405071317);
+    CHECK(self_power_sum_parallel(100'000, ten_ten, 3) == self_power_sum_batched(100'000, ten_ten));
+    CHECK(self_power_sum_parallel(20'000, 1'000'000'007, 2) == self_power_sum_batched(20'000, 1'000'000'007));
+    CHECK(self_power_sum_parallel(20'000, 64 * 81 * 49, 4) == self_power_sum_batched(20'000, 64 * 81 * 49));
+    // prime moduli near 1e18 and above 2^63, where unreduced sums of residues overflow
+    CHECK(self_power_sum_batched(20'000, 1'000'000'000'000'000'003) == 424'827'822'926'962'714);
+    CHECK(self_power_sum_parallel(20'000, 1'000'000'000'000'000'003, 3) == 424'827'822'926'962'714);
+    CHECK(self_power_sum_batched(20'000, 18'446'744'073'709'551'557ull) == 11'538'579'534'851'552'658ull);
+    CHECK(self_power_sum_parallel(20'000, 18'446'744'073'709'551'557ull, 2) == 11'538'579'534'851'552'658ull);
+    CHECK(self_power_sum_periodic(20'000, 1'000'000'000'000'000'003, 2) == 424'827'822'926'962'714);
+    CHECK(self_power_sum_periodic(20'000, 18'446'744'073'709'551'557ull) == 11'538'579'534'851'552'658ull);
+    CHECK(self_power_period(18'446'744'073'709'551'557ull).period == UINT64_MAX);
+    CHECK(!periodic_sum_is_cheaper(1'000'000'000'000, 18'446'744'073'709'551'557ull));
+
+    // the exponent of the unit group mod 10^10 is lambda = 5e8, a tenth of phi = 4e9 from the comment above
+    CHECK(phi(ten_ten) == 4'000'000'000);
+    CHECK(pow_mod_reduced(99, 99 + carmichael_lambda(ten_ten), ten_ten) == 9200499899);
+
+    CHECK(self_power_period(ten_ten).period == ten_ten);
+    CHECK(self_power_period(ten_ten).pre_period == 9);
+    CHECK(self_power_period(7).period == 42);
+    for (const uint64_t n : {1ull, 5ull, 9ull, 10ull, 4'321ull, 62'500ull, 62'509ull, 100'000ull}) {
+        CHECK(self_power_sum_periodic(n, 10'000) == self_power_sum_batched(n, 10'000));
+        CHECK(self_power_sum_periodic(n, 1'000'000, 2) == self_power_sum_batched(n, 1'000'000));
+        CHECK(self_power_sum_periodic(n, 64 * 81 * 49) == self_power_sum_batched(n, 64 * 81 * 49));
+    }
+    // shifting n by a whole period adds one period's sum
+    const uint64_t big = 1'000'000'000'000'000'000ull;
+    const uint64_t period = self_power_period(10'000).period;
+    const uint64_t one_period = (self_power_sum_periodic(period + 3, 10'000) + 10'000 - self_power_sum_periodic(3, 10'000)) % 10'000;
+    CHECK(self_power_sum_periodic(big + period, 10'000) == (self_power_sum_periodic(big, 10'000) + one_period) % 10'000);
+
+    // 10^10 splits into 2^10 and 5^10, whose periods add up to 1024 + 4 * 5^10 terms
+    CHECK(!periodic_sum_is_cheaper(1'000, 10'000'000'000));
+    CHECK(!periodic_sum_is_cheaper(39'000'000, 10'000'000'000));
+    CHECK(periodic_sum_is_cheaper(100'000'000, 10'000'000'000));
+    CHECK(self_power_sum_fastest(1'000, 10'000'000'000) == 9'110'846'700);
+    CHECK(self_power_sum_fastest(200'000, 10'000) == self_power_sum_batched(200'000, 10'000));
+
+    CHECK(self_power_sum_last_digits<1>(1'000, 10) == "9110846700");
+    CHECK(self_power_sum_last_digits<1>(10, 10) == "0405071317");
+    CHECK(self_power_sum_last_digits<2>(1'000, 30) == "383642350667978127819110846700");
+    CHECK(self_power_sum_last_digits<6>(1'000, 100) == "6976906544473978017455720367929981796023041785852626797271283465789498383642350667978127819110846700");
+    const std::string exact = self_power_sum_exact(1'000).to_string();
+    CHECK(exact.size() == 3001);
+    CHECK(exact.starts_with("1000368199"));
+    CHECK(exact.ends_with(self_power_sum_last_digits<6>(1'000, 100)));
+    CHECK(self_power_sum_exact(10).to_string() == "10405071317");
+    CHECK(self_power_sum_last_digits<6>(10'000, 100) == "4185339825389046184310229565321161151092085259150316026394753230301057223656223127837280816237204500");
 }
 
 int main(int argc, char** argv) {
@@ -119,20 +351,30 @@ int main(int argc, char** argv) {
     auto start = high_resolution_clock::now();
     
     // get our large power of ten
-    uint64_t m = 10;
+    constexpr uint64_t m = 10;
+    // problem048 [n]
     uint64_t n = 1000;
+    if (argc >= 2 && std::isdigit(static_cast<unsigned char>(argv[1][0]))) {
+        n = std::stoull(argv[1]);
+    }
+
     uint64_t ten_to_the_m = 1;
     for (uint64_t i = 0; i < m; i ++) {
         ten_to_the_m *= 10;
     }
 
     // compute the answer
-    uint64_t answer = 0;
-    for (uint64_t i = 1; i <= n; i++) {
-        answer += pow_mod_n(i, i, ten_to_the_m);
-    }
+    uint64_t answer = self_power_sum_fastest(n, ten_to_the_m);
 
-    std::cout<< "Answer = " << answer % ten_to_the_m << std::endl;
+    std::cout<< "Answer = " << answer << " (last " << m << " digits)" << std::endl;
+    // the wide sum costs one multi-limb exponentiation per term
+    if (n <= 100'000) {
+        std::cout << "Last 100 digits: " << self_power_sum_last_digits<6>(n, 100) << std::endl;
+    }
+    if (n <= 10'000) {
+        const std::string exact = self_power_sum_exact(n).to_string();
+        std::cout << "Exact sum: " << exact.substr(0, 20) << "... (" << exact.size() << " digits)" << std::endl;
+    }
 
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<std::chrono::microseconds>(stop - start);
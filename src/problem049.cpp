@@ -3,88 +3,499 @@
 #include "common.h"
 
 #include <algorithm>
+#include <cctype>
+#include <atomic>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <sstream>
 #include <stdio.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 using namespace std::chrono;
 
-bool ispermutation(int a, int b) {
-    int digits[10] = {0};
-    while (a != 0) {
-        digits[a%10]++;
-        a /= 10;
+bool ispermutation(const uint64_t a, const uint64_t b) {
+    return digit_signature(a) == digit_signature(b);
+}
+
+TEST_CASE("permutations") {
+    CHECK(ispermutation(1234, 4321));
+    CHECK(!ispermutation(1234, 1235));
+    CHECK(ispermutation(1487, 8147));
+    CHECK(!ispermutation(1000, 100));
+}
+
+
+// Primes grouped into digit permutation classes. Each class is found through its digit signature
+// in a flat open-addressing table, and the members of every class are stored back to back
+// (offsets into one array), in increasing order when the input is sorted.
+class DigitSignatureIndex {
+public:
+    explicit DigitSignatureIndex(std::span<const uint64_t> primes, unsigned threads = 0) : table_(primes.size() / 2 + 1) {
+        std::vector<uint64_t> keys(primes.size());
+        parallel_for(0, primes.size(), [&](uint64_t lo, uint64_t hi) {
+            for (uint64_t i = lo; i < hi; i++) {
+                keys[i] = digit_signature(primes[i]);
+            }
+        }, threads);
+        build(primes, keys);
+    }
+
+    // keys come straight from the table's BCD digits when it has them
+    explicit DigitSignatureIndex(const PrimeTable &table, unsigned threads = 0) : table_(table.size() / 2 + 1) {
+        if (!table.has_bcd()) {
+            *this = DigitSignatureIndex(table.primes(), threads);
+            return;
+        }
+        std::vector<uint64_t> keys(table.size());
+        parallel_for(0, table.size(), [&](uint64_t lo, uint64_t hi) {
+            for (uint64_t i = lo; i < hi; i++) {
+                keys[i] = bcd_signature(table.bcd()[i]);
+            }
+        }, threads);
+        build(table.primes(), keys);
+    }
+
+    size_t classes() const { return keys_.size(); }
+    uint64_t key(const size_t c) const { return keys_[c]; }
+
+    std::span<const uint64_t> members(const size_t c) const {
+        return std::span<const uint64_t>(members_).subspan(offsets_[c], offsets_[c + 1] - offsets_[c]);
     }
 
-    while (b != 0) {
-        digits[b%10]--;
-        b /= 10;
+    // the primes with this digit signature, empty if there are none
+    std::span<const uint64_t> find(const uint64_t key) const {
+        const uint64_t *c = table_.find(key);
+        return c ? members(*c) : std::span<const uint64_t>();
     }
 
-    for (int i = 0; i < 10; i++) {
-        if (digits[i] != 0)
-            return false;
+    std::span<const uint64_t> permutations_of(const uint64_t n) const {
+        return find(digit_signature(n));
     }
-    return true;
+
+private:
+    void build(std::span<const uint64_t> primes, const std::vector<uint64_t> &keys) {
+
+        // number the classes in order of first appearance and count their members
+        std::vector<uint32_t> class_of(primes.size());
+        std::vector<uint64_t> counts;
+        for (size_t i = 0; i < primes.size(); i++) {
+            table_.insert(keys[i], keys_.size());
+            const uint64_t c = *table_.find(keys[i]);
+            if (c == keys_.size()) {
+                keys_.push_back(keys[i]);
+                counts.push_back(0);
+            }
+            class_of[i] = static_cast<uint32_t>(c);
+            counts[c]++;
+        }
+
+        offsets_.assign(keys_.size() + 1, 0);
+        for (size_t c = 0; c < keys_.size(); c++) {
+            offsets_[c + 1] = offsets_[c] + counts[c];
+        }
+        members_.resize(primes.size());
+        std::vector<uint64_t> fill(offsets_.begin(), offsets_.end() - 1);
+        for (size_t i = 0; i < primes.size(); i++) {
+            members_[fill[class_of[i]]++] = primes[i];
+        }
+    }
+
+    FlatMap64 table_;
+    std::vector<uint64_t> keys_;
+    std::vector<uint64_t> offsets_;
+    std::vector<uint64_t> members_;
+};
+
+// the 4-digit primes
+std::vector<uint64_t> four_digit_primes() {
+    const PrimeTable table(1'000, 10'000);
+    return std::vector<uint64_t>(table.primes().begin(), table.primes().end());
 }
 
-TEST_CASE("permutations") {
-    CHECK(ispermutation(1234, 4321));
-    CHECK(!ispermutation(1234, 1235));
+TEST_CASE("digit signature index") {
+    const auto prime_list = four_digit_primes();
+    const DigitSignatureIndex index(prime_list, 3);
+
+    auto cls = index.permutations_of(1487);
+    CHECK(std::is_sorted(cls.begin(), cls.end()));
+    for (const uint64_t p : {1487, 4817, 8147}) {
+        CHECK(std::binary_search(cls.begin(), cls.end(), p));
+    }
+    CHECK(index.permutations_of(1000).empty());
+
+    // every prime lands in exactly the class of its permutations
+    size_t total = 0;
+    for (size_t c = 0; c < index.classes(); c++) {
+        for (const uint64_t p : index.members(c)) {
+            CHECK(digit_signature(p) == index.key(c));
+        }
+        total += index.members(c).size();
+    }
+    CHECK(total == prime_list.size());
+    size_t brute = 0;
+    for (const uint64_t p : prime_list) {
+        brute += ispermutation(1487, p);
+    }
+    CHECK(cls.size() == brute);
+
+    // keyed from BCD digits, the classes come out the same
+    const DigitSignatureIndex from_bcd(PrimeTable(1'000, 10'000, true), 2);
+    REQUIRE(from_bcd.classes() == index.classes());
+    for (size_t c = 0; c < index.classes(); c++) {
+        CHECK(from_bcd.key(c) == index.key(c));
+        CHECK(std::ranges::equal(from_bcd.members(c), index.members(c)));
+    }
+}
+
+// Calls f(signature) for every multiset of length digits that is not all zeros
+template <typename F>
+void for_each_digit_multiset(const int length, F f) {
+    auto place = [&](auto &self, const int digit, const int left, const uint64_t signature) -> void {
+        if (digit == 9) {
+            const uint64_t full = signature + (uint64_t{static_cast<unsigned>(left)} << 36);
+            if (full != static_cast<uint64_t>(length)) {
+                f(full);
+            }
+            return;
+        }
+        for (int c = left; c >= 0; c--) {
+            self(self, digit + 1, left - c, signature + (uint64_t{static_cast<unsigned>(c)} << (4 * digit)));
+        }
+    };
+    place(place, 0, length, 0);
+}
+
+// k-term progressions of primes within a digit permutation class, over all length-digit numbers.
+// Each class is built once by enumerating its distinct permutations and keeping the primes, which
+// come out sorted; f(first, difference) sees every progression. Returns how many there were.
+template <typename F>
+uint64_t permutation_class_progressions(const int length, const int k, F f) {
+    assert(length >= 1 && length <= 15);
+    uint64_t limit = 1;
+    for (int i = 0; i < length; i++) {
+        limit *= 10;
+    }
+    // below 10^8 a bitmap is small, past it Miller-Rabin is cheaper than the sieve
+    const Bitmap sieve = length <= 8 ? prime_bitmap(limit) : Bitmap();
+    auto is_prime_n = [&](const uint64_t n) { return length <= 8 ? sieve.test(n) : is_prime_u64(n); };
+
+    uint64_t found = 0;
+    ApDetector detector(k);
+    std::vector<uint64_t> class_primes;
+    for_each_digit_multiset(length, [&](const uint64_t signature) {
+        class_primes.clear();
+        for_each_digit_permutation(signature, [&](const uint64_t n) {
+            if (is_prime_n(n)) {
+                class_primes.push_back(n);
+            }
+        });
+        found += detector.find(class_primes, f);
+    });
+    return found;
 }
 
+TEST_CASE("permutation classes") {
+    // the enumerated classes agree with the index built from the prime list
+    const auto prime_list = four_digit_primes();
+    const DigitSignatureIndex index(prime_list);
+    int multisets = 0;
+    for_each_digit_multiset(4, [&](const uint64_t signature) {
+        multisets++;
+        CHECK(signature_length(signature) == 4);
+        std::vector<uint64_t> class_primes;
+        for_each_digit_permutation(signature, [&](const uint64_t n) {
+            if (is_prime_u64(n)) {
+                class_primes.push_back(n);
+            }
+        });
+        const auto expected = index.find(signature);
+        CHECK(std::equal(class_primes.begin(), class_primes.end(), expected.begin(), expected.end()));
+    });
+    CHECK(multisets == 714);    // C(13, 4) multisets, less 0000
+
+    std::vector<uint64_t> starts;
+    CHECK(permutation_class_progressions(4, 3, [&](uint64_t a, uint64_t) { starts.push_back(a); }) == 2);
+    std::sort(starts.begin(), starts.end());
+    CHECK(starts == std::vector<uint64_t>{1487, 2969});
+
+    // the per-class search agrees with a scan of every pair of primes
+    const Bitmap sieve = prime_bitmap(100'000);
+    std::vector<uint64_t> five_digit;
+    for (uint64_t n = 10'001; n < 100'000; n += 2) {
+        if (sieve.test(n)) {
+            five_digit.push_back(n);
+        }
+    }
+    uint64_t brute = 0;
+    for (size_t i = 0; i < five_digit.size(); i++) {
+        const uint64_t a = five_digit[i];
+        for (size_t j = i + 1; j < five_digit.size() && 2 * five_digit[j] - a < 100'000; j++) {
+            const uint64_t b = five_digit[j];
+            brute += sieve.test(2 * b - a) && digit_signature(a) == digit_signature(b)
+                     && digit_signature(a) == digit_signature(2 * b - a);
+        }
+    }
+    CHECK(permutation_class_progressions(5, 3, [](uint64_t, uint64_t) {}) == brute);
+}
 
-void problem49() {
+// Where the parallel scan keeps its records, and how much memory they may take before
+// partitions are spilled to files in spill_dir
+struct ScanOptions {
+    uint64_t memory_budget = uint64_t{8} << 30;
+    std::filesystem::path spill_dir = std::filesystem::temp_directory_path();
+    unsigned threads = 0;
+};
 
-    auto const sieve = prime_sieve(10'000);
-    auto const prime_list = primes(10'000);
+// The same search as permutation_class_progressions, for lengths where holding every prime's class
+// at once is too much (4e8 primes at 10 digits):
+//  1. workers sieve interleaved segments and append (signature, prime) records to their own buffers,
+//     one per partition, chosen by a hash of the signature, so a class never straddles partitions;
+//  2. while the buffered total is over the memory budget, a worker appends its buffers to one
+//     file per partition and frees them;
+//  3. partitions are then loaded (buffers plus file), sorted by signature and scanned for
+//     progressions class by class, in parallel.
+// f(first, difference) sees every progression in increasing order. Returns how many there were,
+// or nothing if a spill file could not be written or read back in full; the reason goes to error
+// (if given) and the run's spill files are removed. Spill file names carry a per-run id, so
+// concurrent runs can share spill_dir.
+template <typename F>
+std::optional<uint64_t> scan_permutation_classes(const int length, const int k, const ScanOptions &options, F f,
+                                                 std::string *error = nullptr) {
+    assert(length >= 1 && length <= 16);
+    struct Record {
+        uint64_t key;
+        uint64_t prime;
+        bool operator<(const Record &other) const {
+            return key != other.key ? key < other.key : prime < other.prime;
+        }
+    };
+    constexpr int PARTITION_BITS = 8;
+    constexpr size_t PARTITIONS = size_t{1} << PARTITION_BITS;
+    constexpr uint64_t SEGMENT = uint64_t{1} << 21;
+    auto partition_of = [](const uint64_t key) { return (key * 0x9E37'79B9'7F4A'7C15ull) >> (64 - PARTITION_BITS); };
 
-    // find location of first prime number greater than 1000
-    int ind = -1;
-    for (size_t i = 0; i < prime_list.size(); i++) {
-        if (prime_list[i] > 1000) {
-            ind = i;
-            break;
+    uint64_t lo = 1;
+    for (int i = 1; i < length; i++) {
+        lo *= 10;
+    }
+    const uint64_t hi = 10 * lo;
+    const auto root_sieve = prime_bitmap(static_cast<uint64_t>(std::sqrt(static_cast<double>(hi))) + 1);
+    std::vector<uint64_t> base;
+    for (uint64_t i = 2; i < root_sieve.size; i++) {
+        if (root_sieve.test(i)) {
+            base.push_back(i);
         }
     }
 
-    int found_answers = 0;
-    const int max_answers = 2;
+    const unsigned threads = options.threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.threads;
+    std::random_device entropy;
+    const uint64_t run_id = (uint64_t{entropy()} << 32 | entropy()) ^ steady_clock::now().time_since_epoch().count();
+    std::ostringstream prefix;
+    prefix << "perm_classes_" << length << "_" << std::hex << run_id << "_";
+    const std::string spill_prefix = prefix.str();
+    auto spill_path = [&](const size_t p) { return options.spill_dir / (spill_prefix + std::to_string(p) + ".bin"); };
 
-    std::cout<< "starting prime: "<< prime_list[ind] << "\n";
+    // the first failure is kept, and every worker stops at its next check
+    std::atomic<bool> failed{false};
+    std::mutex error_lock;
+    std::string first_error;
+    auto fail = [&](const std::string &message) {
+        std::lock_guard<std::mutex> lock(error_lock);
+        if (!failed.exchange(true)) {
+            first_error = message;
+        }
+    };
+    std::vector<uint64_t> spilled_bytes(PARTITIONS, 0);
+    auto give_up = [&]() -> std::optional<uint64_t> {
+        std::error_code ignored;
+        for (size_t p = 0; p < PARTITIONS; p++) {
+            if (spilled_bytes[p] > 0) {
+                std::filesystem::remove(spill_path(p), ignored);
+            }
+        }
+        if (error) {
+            *error = first_error;
+        }
+        return std::nullopt;
+    };
+
+    std::error_code ec;
+    if (!std::filesystem::create_directories(options.spill_dir, ec) && !std::filesystem::is_directory(options.spill_dir, ec)) {
+        fail("spill directory " + options.spill_dir.string() + " cannot be used");
+        return give_up();
+    }
 
-    const int last_prime = prime_list[prime_list.size()-1];
+    std::vector<std::vector<std::vector<Record>>> buffers(threads, std::vector<std::vector<Record>>(PARTITIONS));
+    std::vector<std::mutex> file_locks(PARTITIONS);
+    std::atomic<uint64_t> buffered_bytes{0};
 
-    std::cout << "last prime: " << last_prime << "\n";
- 
-    // iterate over starting primes
-    for (size_t i = ind; i < prime_list.size(); i++) {
-        // todo: would be way faster to just generate all possible permutations, then check for primality of permutations, then
-        // check for arithmetic sequences.
-        int n1 = prime_list[i];
-        // intervals have to be even numbers
-        // maximum possible interval is (last_prime - n1) / 2
-        for (int interval = 2; interval < (last_prime - n1) / 2; interval+=2) {
-            int n2 = n1 + interval;
-            if (!sieve[n2]) {
-                continue;
+    const uint64_t segments = (hi - lo + SEGMENT - 1) / SEGMENT;
+    parallel_for(0, threads, [&](uint64_t t_lo, uint64_t t_hi) {
+        for (uint64_t t = t_lo; t < t_hi; t++) {
+            auto &own = buffers[t];
+            uint64_t own_bytes = 0;
+            for (uint64_t s = t; s < segments && !failed; s += threads) {
+                const uint64_t a = lo + s * SEGMENT;
+                const uint64_t b = std::min(hi, a + SEGMENT);
+                const Bitmap primes = segmented_prime_bitmap(a, b, base);
+                uint64_t added = 0;
+                for (uint64_t n = a; n < b; n++) {
+                    if (primes.test(n - a)) {
+                        const uint64_t key = digit_signature(n);
+                        own[partition_of(key)].push_back(Record{key, n});
+                        added += sizeof(Record);
+                    }
+                }
+                own_bytes += added;
+                if (buffered_bytes.fetch_add(added) + added > options.memory_budget) {
+                    for (size_t p = 0; p < PARTITIONS && !failed; p++) {
+                        if (own[p].empty()) {
+                            continue;
+                        }
+                        std::lock_guard<std::mutex> lock(file_locks[p]);
+                        const uint64_t bytes = own[p].size() * sizeof(Record);
+                        std::ofstream out(spill_path(p), spilled_bytes[p] ? std::ios::binary | std::ios::app : std::ios::binary | std::ios::trunc);
+                        out.write(reinterpret_cast<const char *>(own[p].data()), bytes);
+                        out.close();
+                        // counted even on failure, so the partial file is cleaned up
+                        spilled_bytes[p] += bytes;
+                        if (!out) {
+                            fail("writing " + spill_path(p).string() + " failed");
+                            break;
+                        }
+                        std::vector<Record>().swap(own[p]);
+                    }
+                    buffered_bytes -= own_bytes;
+                    own_bytes = 0;
+                }
             }
-            int n3 = n2 + interval;
-            if (!sieve[n3]) {
-                continue;
+        }
+    }, threads);
+
+    std::vector<std::vector<std::pair<uint64_t, uint64_t>>> results(PARTITIONS);
+    parallel_for(0, PARTITIONS, [&](uint64_t p_lo, uint64_t p_hi) {
+        ApDetector detector(k);
+        std::vector<Record> records;
+        std::vector<uint64_t> class_primes;
+        for (uint64_t p = p_lo; p < p_hi && !failed; p++) {
+            records.clear();
+            if (spilled_bytes[p] > 0) {
+                // ask for one record more than was written, so a file that grew is caught too
+                records.resize(spilled_bytes[p] / sizeof(Record) + 1);
+                std::ifstream in(spill_path(p), std::ios::binary);
+                in.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(Record));
+                const uint64_t read = static_cast<uint64_t>(in.gcount());
+                if (read != spilled_bytes[p]) {
+                    fail("read " + std::to_string(read) + " of " + std::to_string(spilled_bytes[p]) + " bytes back from " + spill_path(p).string());
+                    break;
+                }
+                records.resize(read / sizeof(Record));
+                in.close();
+                std::error_code ignored;
+                std::filesystem::remove(spill_path(p), ignored);
+                spilled_bytes[p] = 0;
             }
-            if (!ispermutation(n1, n2)) {
-                continue;
+            for (auto &own : buffers) {
+                records.insert(records.end(), own[p].begin(), own[p].end());
+                std::vector<Record>().swap(own[p]);
             }
-            if (!ispermutation(n1, n3)) {
-                continue;
+            std::sort(records.begin(), records.end());
+
+            for (size_t i = 0; i < records.size();) {
+                size_t j = i;
+                class_primes.clear();
+                while (j < records.size() && records[j].key == records[i].key) {
+                    class_primes.push_back(records[j++].prime);
+                }
+                detector.find(class_primes, [&](uint64_t first, uint64_t d) { results[p].emplace_back(first, d); });
+                i = j;
             }
-            std::cout << "found answer (interval=" << interval << "): " << n1 << " " << n2 << " " <<  n3 << "\n";
-            found_answers += 1;
-            if (found_answers == max_answers) {
-                return;
+        }
+    }, threads);
+    if (failed) {
+        return give_up();
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> all;
+    for (auto &r : results) {
+        all.insert(all.end(), r.begin(), r.end());
+    }
+    std::sort(all.begin(), all.end());
+    for (const auto &[first, d] : all) {
+        f(first, d);
+    }
+    return all.size();
+}
+
+TEST_CASE("parallel permutation class scan") {
+    std::vector<std::pair<uint64_t, uint64_t>> expected;
+    permutation_class_progressions(6, 3, [&](uint64_t a, uint64_t d) { expected.emplace_back(a, d); });
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(expected.size() == 828);
+
+    // spill files of this length left in dir
+    auto leftovers = [](const std::filesystem::path &dir) {
+        int count = 0;
+        for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+            count += entry.path().filename().string().starts_with("perm_classes_6_");
+        }
+        return count;
+    };
+
+    // all in memory, then a budget small enough that every segment spills
+    for (const uint64_t budget : {uint64_t{1} << 30, uint64_t{4'096}}) {
+        ScanOptions options;
+        options.memory_budget = budget;
+        options.threads = 3;
+        const int before = leftovers(options.spill_dir);
+        std::vector<std::pair<uint64_t, uint64_t>> found;
+        CHECK(scan_permutation_classes(6, 3, options, [&](uint64_t a, uint64_t d) { found.emplace_back(a, d); }) == 828);
+        CHECK(found == expected);
+        CHECK(leftovers(options.spill_dir) == before);
+    }
+
+    // a spill directory that cannot exist (its parent is a file) is reported, not run into
+    const std::filesystem::path blocker = std::filesystem::temp_directory_path() / "perm_classes_test_blocker";
+    std::ofstream(blocker) << "not a directory";
+    ScanOptions options;
+    options.memory_budget = 4'096;
+    options.threads = 2;
+    options.spill_dir = blocker / "spill";
+    std::string error;
+    CHECK(!scan_permutation_classes(6, 3, options, [](uint64_t, uint64_t) {}, &error).has_value());
+    CHECK(error.find("spill directory") != std::string::npos);
+    std::filesystem::remove(blocker);
+}
+
+// Lengths from here on go through the parallel scan
+constexpr int SCAN_DIGITS = 8;
+
+bool problem49(const int length, const int k, const ScanOptions &options) {
+    auto report = [&](uint64_t a, uint64_t d) {
+        if (length == 4) {
+            std::cout << "found answer (interval=" << d << "):";
+            for (int t = 0; t < k; t++) {
+                std::cout << " " << a + t * d;
             }
+            std::cout << "\n";
         }
+    };
+    std::string error;
+    const std::optional<uint64_t> found = length >= SCAN_DIGITS ? scan_permutation_classes(length, k, options, report, &error)
+                                                                : permutation_class_progressions(length, k, report);
+    if (!found) {
+        std::cout << "Scan failed: " << error << "\n";
+        return false;
     }
-    return;
+    std::cout << *found << " " << k << "-term progressions among " << length << "-digit prime permutations\n";
+    return true;
 }
 
 int main(int argc, char** argv) {
@@ -106,8 +517,25 @@ int main(int argc, char** argv) {
         
     auto start = high_resolution_clock::now();
     
-    // CODE GOES HERE
-    problem49();
+    // problem049 [digits] [terms] [memory budget in MiB] [spill directory]
+    int length = 4;
+    int k = 3;
+    ScanOptions options;
+    if (argc >= 2 && std::isdigit(static_cast<unsigned char>(argv[1][0]))) {
+        length = std::stoi(argv[1]);
+    }
+    if (argc >= 3 && std::isdigit(static_cast<unsigned char>(argv[2][0]))) {
+        k = std::stoi(argv[2]);
+    }
+    if (argc >= 4 && std::isdigit(static_cast<unsigned char>(argv[3][0]))) {
+        options.memory_budget = std::stoull(argv[3]) << 20;
+    }
+    if (argc >= 5 && argv[4][0] != '-') {
+        options.spill_dir = argv[4];
+    }
+    if (!problem49(length, k, options)) {
+        return 1;
+    }
 
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<std::chrono::microseconds>(stop - start);
@@ -2,89 +2,385 @@
 #include "doctest.h"
 #include "common.h"
 
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 using namespace std::chrono;
 
 
-tuple<vector<bool>, vector<int>, vector<int>> primes_and_sieve(int n) {
+// The primes in increasing order with their prefix sums, extended a segment at a time on demand.
+// prefix(i) is the sum of the first i primes, so any window sum is one subtraction.
+class PrimePrefixTable {
+public:
+    explicit PrimePrefixTable(const uint64_t initial_limit = 1 << 16) : limit_(std::max<uint64_t>(initial_limit, 16)) {
+        const Bitmap sieve = prime_bitmap(limit_ - 1);
+        prefix_.push_back(0);
+        for (uint64_t n = 2; n < limit_; n++) {
+            if (sieve.test(n)) {
+                append(n);
+            }
+        }
+    }
 
-    std::vector<bool> sieve(n+1, true);
-    sieve[1] = false;
+    size_t size() const { return primes_.size(); }
+    uint64_t prime(const size_t i) const { return primes_[i]; }
+    uint64_t prefix(const size_t i) const { return prefix_[i]; }
+    uint64_t window_sum(const size_t start, const size_t length) const { return prefix_[start + length] - prefix_[start]; }
 
-    // fill evens with false
-    for (int i = 0; i <= n; i+=2) {
-        sieve[i] = false;
+    // grows until there are at least count primes; the base primes for the next segment are
+    // already in the list, since sqrt(2 limit) < limit
+    void ensure(const size_t count) {
+        while (primes_.size() < count) {
+            const uint64_t hi = 2 * limit_;
+            const Bitmap segment = segmented_prime_bitmap(limit_, hi, primes_);
+            for (uint64_t n = limit_; n < hi; n++) {
+                if (segment.test(n - limit_)) {
+                    append(n);
+                }
+            }
+            limit_ = hi;
+        }
     }
 
-    // Sieve remaining numbers
-    for (int i = 3; i*i <= n; i+=2) {
-        if (sieve[i]) {
-            for (int j = i*i; j <= n; j +=i) {
-                sieve[j] = false;
-            }
+private:
+    void append(const uint64_t p) {
+        primes_.push_back(p);
+        prefix_.push_back(prefix_.back() + p);
+    }
+
+    uint64_t limit_;
+    std::vector<uint64_t> primes_;
+    std::vector<uint64_t> prefix_;
+};
+
+// Primality of window sums below n: a sieve up to min(n, SUM_SIEVE_LIMIT), Miller-Rabin past it
+constexpr uint64_t SUM_SIEVE_LIMIT = uint64_t{1} << 24;
+
+class SumPrimality {
+public:
+    explicit SumPrimality(const uint64_t n) : sieve_(prime_bitmap(std::min(n, SUM_SIEVE_LIMIT))) {}
+
+    bool operator()(const uint64_t x) const {
+        return x < sieve_.size ? sieve_.test(x) : is_prime_u64(x);
+    }
+
+private:
+    Bitmap sieve_;
+};
+
+struct PrimeWindow {
+    uint64_t length = 0;
+    uint64_t start = 0;         // index of the first prime
+    uint64_t sum = 0;
+
+    bool operator==(const PrimeWindow &) const = default;
+};
+
+// Largest window length whose smallest sum 2 + 3 + ... is below n
+size_t max_window_length(const uint64_t n, PrimePrefixTable &table) {
+    size_t length = 0;
+    for (;; length++) {
+        table.ensure(length + 1);
+        if (table.prefix(length + 1) >= n) {
+            return length;
         }
     }
-    
-    // make list of primes and cumulative sum
-    std::vector<int> _primes{2};
-    std::vector<int> sums{0, 2};
-    int sum = 2;
-    for (int i = 3; i < sieve.size(); i+=2) {
-        if (sieve[i]) {
-            _primes.push_back(i);
-            sum += i;
-            sums.push_back(sum);
+}
+
+// The earliest window of this length with a prime sum below n. Parity prunes most windows:
+// a sum of odd primes is odd only for an odd count, so an even length can only work starting
+// at 2, and an odd length (other than the lone prime 2) never can start there. stop() is polled between
+// windows to abandon the search.
+template <typename Stop>
+std::optional<PrimeWindow> first_prime_window(const uint64_t n, const size_t length, const PrimePrefixTable &table,
+                                              const SumPrimality &is_prime_sum, Stop stop) {
+    if (length % 2 == 0 || length == 1) {
+        const uint64_t sum = table.prefix(length);
+        if (sum < n && is_prime_sum(sum)) {
+            return PrimeWindow{length, 0, sum};
+        }
+        if (length % 2 == 0) {
+            return std::nullopt;
         }
     }
+    for (size_t start = 1; start + length <= table.size(); start++) {
+        const uint64_t sum = table.window_sum(start, length);
+        if (sum >= n || ((start & 1023) == 0 && stop())) {
+            return std::nullopt;
+        }
+        if (is_prime_sum(sum)) {
+            return PrimeWindow{length, start, sum};
+        }
+    }
+    // callers size the table so a window's sum passes n before it runs out of primes
+    assert(false);
+    return std::nullopt;
+}
 
-    return make_tuple(sieve, _primes, sums);
+// Grows the table so every window of length at most longest with a sum below n, for lengths down
+// to shortest, lies inside it: such a window starts below n / shortest, since all its primes do.
+void cover_windows(const uint64_t n, const size_t shortest, const size_t longest, PrimePrefixTable &table) {
+    const uint64_t bound = n / shortest;
+    while (table.prime(table.size() - 1) <= bound) {
+        table.ensure(table.size() + 1);
+    }
+    size_t starts = table.size();
+    while (starts > 0 && table.prime(starts - 1) > bound) {
+        starts--;
+    }
+    table.ensure(starts + longest + 1);
 }
 
-void prime_sequences(int N_max) {
-    int max_size = N_max;
-    const auto [sieve, p, sums]= primes_and_sieve(max_size);
-    
-    int sum = 0;
-    int best_sum = 0;
-    int best_length = 1;
-    int start_ind = 0;
-    int best_start_ind = 0;
-
-    // Naive O(n^2) solution
-    for (int start_ind = 0; start_ind < p.size()-1; start_ind++) {
-        // check if start_ind is even feasible
-        if ((sums[start_ind + best_length + 1] - sums[start_ind]) > N_max) {
-            break;
+// Longest run of consecutive primes whose sum is a prime below n (the earliest such run when
+// there are several). Lengths go from the longest whose smallest sum fits below n down to 1,
+// and the first length with a prime sum is the answer.
+PrimeWindow longest_prime_sum(const uint64_t n, PrimePrefixTable &table, const SumPrimality &is_prime_sum) {
+    // the table only reaches a little past the primes below n / (answer length), so for n up
+    // to 1e15 every prefix sum stays far below 2^64
+    assert(n <= 1'000'000'000'000'000ull);
+    const size_t max_length = max_window_length(n, table);
+    for (size_t length = max_length; length >= 1; length--) {
+        cover_windows(n, length, length, table);
+        if (auto window = first_prime_window(n, length, table, is_prime_sum, [] { return false; })) {
+            return *window;
+        }
+    }
+    return PrimeWindow{};
+}
+
+// The same search with lengths shared out to threads. Lengths are handed out in descending order
+// from an atomic counter, in rounds; the table is grown between rounds to cover the round's
+// shortest length and only read during one. A thread that finds a window raises the shared best
+// length, which stops everyone working on shorter lengths. Each length is searched by one thread
+// from its first start, so the answer (longest length, then earliest start) does not depend on
+// the schedule.
+PrimeWindow longest_prime_sum_parallel(const uint64_t n, PrimePrefixTable &table, const SumPrimality &is_prime_sum,
+                                       unsigned threads = 0) {
+    assert(n <= 1'000'000'000'000'000ull);
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t max_length = max_window_length(n, table);
+
+    std::atomic<size_t> best_length{0};
+    size_t round = 64 * threads;
+    for (size_t longest = max_length; longest >= 1; round *= 2) {
+        // at most a quarter of the lengths left per round: the table has to reach n / shortest,
+        // which for a shortest length near 1 would be every prime below n
+        const size_t shortest = longest - std::min(round, std::max<size_t>(1, longest / 4)) + 1;
+        cover_windows(n, shortest, longest, table);
+
+        std::vector<PrimeWindow> found(longest - shortest + 1);
+        std::atomic<size_t> taken{0};
+        parallel_for(0, threads, [&](uint64_t t_lo, uint64_t t_hi) {
+            for (uint64_t t = t_lo; t < t_hi; t++) {
+                for (size_t i = taken++; i < found.size() && longest - i > best_length.load(); i = taken++) {
+                    const size_t length = longest - i;
+                    auto stop = [&] { return best_length.load(std::memory_order_relaxed) > length; };
+                    if (auto window = first_prime_window(n, length, table, is_prime_sum, stop)) {
+                        found[length - shortest] = *window;
+                        size_t best = best_length.load();
+                        while (length > best && !best_length.compare_exchange_weak(best, length)) {
+                        }
+                    }
+                }
+            }
+        }, threads);
+
+        if (best_length > 0) {
+            return found[best_length - shortest];
         }
-        for (int last_ind = start_ind + best_length; last_ind < p.size() - 1; last_ind++){
-            sum = sums[last_ind + 1] - sums[start_ind];
-            if (sum >= N_max) {
+        longest = shortest - 1;
+    }
+    return PrimeWindow{};
+}
+
+PrimeWindow longest_prime_sum(const uint64_t n, const unsigned threads = 1) {
+    PrimePrefixTable table;
+    const SumPrimality is_prime_sum(n);
+    return threads == 1 ? longest_prime_sum(n, table, is_prime_sum) : longest_prime_sum_parallel(n, table, is_prime_sum, threads);
+}
+
+// Answers for a nondecreasing sequence of limits, each picking up where the last one stopped.
+// Each length keeps a cursor at its next unchecked start: a window's sum grows with its start,
+// so the first prime-sum window of a length is also its smallest, and once found it is the
+// length's answer for every larger limit. A limit only advances the cursors of lengths longer
+// than the best so far, and only while their sums stay below it, so the whole batch costs about
+// as much as a single search for its largest limit.
+class PrimeSumSweep {
+public:
+    explicit PrimeSumSweep(const uint64_t max_limit) : is_prime_sum_(max_limit), max_limit_(max_limit) {
+        assert(max_limit <= 1'000'000'000'000'000ull);
+        cursors_.push_back(Cursor{});
+    }
+
+    PrimeWindow answer(const uint64_t n) {
+        assert(n >= last_limit_ && n <= max_limit_);
+        last_limit_ = n;
+        for (;; longest_++) {
+            table_.ensure(longest_ + 1);
+            if (table_.prefix(longest_ + 1) >= n) {
                 break;
             }
-            if (sieve[sum]) {
-                int len = last_ind - start_ind + 1;
-                if (len > best_length) {
-                    best_length = len;
-                    best_start_ind = start_ind;
-                    best_sum = sum;
-                }
+            // even lengths only ever start at 2, odd ones other than 1 never do
+            const size_t length = longest_ + 1;
+            Cursor cursor;
+            cursor.next_start = length % 2 == 0 || length == 1 ? 0 : 1;
+            cursors_.push_back(cursor);
+        }
+        for (size_t length = longest_; length > best_.length; length--) {
+            if (advance(n, length)) {
+                best_ = cursors_[length].window;
+                break;
+            }
+        }
+        return best_;
+    }
+
+private:
+    struct Cursor {
+        size_t next_start = 0;
+        bool found = false;
+        bool exhausted = false;
+        PrimeWindow window;
+    };
+
+    // checks this length's windows with sums below n, stopping at the first prime sum
+    bool advance(const uint64_t n, const size_t length) {
+        Cursor &c = cursors_[length];
+        while (!c.found && !c.exhausted) {
+            table_.ensure(c.next_start + length);
+            const uint64_t sum = table_.window_sum(c.next_start, length);
+            if (sum >= n) {
+                break;
+            }
+            if (is_prime_sum_(sum)) {
+                c.found = true;
+                c.window = PrimeWindow{length, c.next_start, sum};
+            } else if (length % 2 == 0) {
+                c.exhausted = true;
+            } else {
+                c.next_start++;
+            }
+        }
+        return c.found;
+    }
+
+    PrimePrefixTable table_;
+    SumPrimality is_prime_sum_;
+    uint64_t max_limit_;
+    uint64_t last_limit_ = 0;
+    size_t longest_ = 0;                // longest length whose smallest sum is below the last limit
+    std::vector<Cursor> cursors_;       // indexed by length
+    PrimeWindow best_;
+};
+
+// Answers a batch of limits offline: sorted, they share one table and one sweep. f(i, window)
+// gets the answer for limits[i], in input order, as soon as it and every earlier one are known.
+template <typename F>
+void longest_prime_sums(std::span<const uint64_t> limits, F f) {
+    if (limits.empty()) {
+        return;
+    }
+    std::vector<size_t> order(limits.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return limits[a] < limits[b]; });
+
+    PrimeSumSweep sweep(limits[order.back()]);
+    std::vector<PrimeWindow> answers(limits.size());
+    std::vector<bool> done(limits.size(), false);
+    size_t emitted = 0;
+    for (const size_t i : order) {
+        answers[i] = sweep.answer(limits[i]);
+        done[i] = true;
+        for (; emitted < limits.size() && done[emitted]; emitted++) {
+            f(emitted, answers[emitted]);
+        }
+    }
+}
+
+// Every window checked, for the tests
+PrimeWindow longest_prime_sum_naive(const uint64_t n) {
+    const auto p = primes(static_cast<int>(n));
+    PrimeWindow best;
+    for (size_t start = 0; start < p.size(); start++) {
+        uint64_t sum = 0;
+        for (size_t end = start; end < p.size(); end++) {
+            sum += p[end];
+            if (sum >= n) {
+                break;
+            }
+            if (end - start + 1 > best.length && is_prime_u64(sum)) {
+                best = PrimeWindow{end - start + 1, start, sum};
             }
         }
     }
+    return best;
+}
+
+TEST_CASE("consecutive prime sums") {
+    CHECK(longest_prime_sum(100) == PrimeWindow{6, 0, 41});
+    CHECK(longest_prime_sum(1'000) == PrimeWindow{21, 3, 953});
+    CHECK(longest_prime_sum(1'000'000) == PrimeWindow{543, 3, 997'651});
+    CHECK(longest_prime_sum(1'000'000'000).sum == 999'715'711);
+    const PrimeWindow trillion = longest_prime_sum(1'000'000'000'000);
+    CHECK(trillion.length == 379'317);
+    CHECK(trillion.sum == 999'973'156'643);
+    PrimePrefixTable table(16);
+    for (uint64_t n = 3; n < 3'000; n += 7) {
+        const SumPrimality is_prime_sum(n);
+        const PrimeWindow expected = longest_prime_sum_naive(n);
+        CHECK(longest_prime_sum(n, table, is_prime_sum) == expected);
+        CHECK(longest_prime_sum_parallel(n, table, is_prime_sum, 1 + n % 4) == expected);
+    }
 
-    std::cout << "Best length: " << best_length << std::endl;
-    std::cout << "Sum: " << best_sum << std::endl;
-    // int checksum = -best_sum;
-    // for (int i = best_start_ind; i < best_start_ind + best_length; i++) {
-    //     std::cout << p[i];
-    //     checksum += p[i];
-    //     if (i < best_start_ind + best_length - 1) {
-    //         std::cout << ", ";
-    //     } else {
-    //         std::cout << std::endl;
-    //     }
-    // }
-    // std::cout<< "Checksum: " << checksum << std::endl; 
+    // with many threads a round could otherwise reach down to length 1 and pull in every prime below n
+    PrimePrefixTable shared;
+    CHECK(longest_prime_sum_parallel(10'000'000, shared, SumPrimality(10'000'000), 32) == longest_prime_sum(10'000'000));
+    CHECK(shared.size() < 100'000);
+
+    // the parallel search lands on the same window whatever the thread count
+    for (const unsigned threads : {2u, 3u, 8u}) {
+        CHECK(longest_prime_sum(1'000'000, threads) == PrimeWindow{543, 3, 997'651});
+        CHECK(longest_prime_sum(1'000'000'000, threads) == longest_prime_sum(1'000'000'000));
+    }
+}
+
+TEST_CASE("batched consecutive prime sums") {
+    std::vector<uint64_t> limits;
+    for (uint64_t n = 0; n < 3'000; n += 7) {
+        limits.push_back((n * 1'237) % 3'000);
+    }
+    limits.push_back(limits[5]);
+    size_t next = 0;
+    longest_prime_sums(limits, [&](const size_t i, const PrimeWindow &window) {
+        CHECK(i == next++);
+        CHECK(window == longest_prime_sum_naive(limits[i]));
+    });
+    CHECK(next == limits.size());
+
+    const std::vector<uint64_t> large = {1'000'000, 100, 1'000'000'000, 1'000, 1'000'000, 54'321'987};
+    std::vector<PrimeWindow> answers;
+    longest_prime_sums(large, [&](size_t, const PrimeWindow &window) { answers.push_back(window); });
+    REQUIRE(answers.size() == large.size());
+    CHECK(answers[0] == PrimeWindow{543, 3, 997'651});
+    CHECK(answers[1] == PrimeWindow{6, 0, 41});
+    CHECK(answers[2].sum == 999'715'711);
+    CHECK(answers[3] == PrimeWindow{21, 3, 953});
+    CHECK(answers[4] == answers[0]);
+    CHECK(answers[5] == longest_prime_sum(54'321'987));
+}
+
+void prime_sequences(const uint64_t n) {
+    const PrimeWindow best = longest_prime_sum(n, std::max(1u, std::thread::hardware_concurrency()));
+    std::cout << "Best length: " << best.length << std::endl;
+    std::cout << "Sum: " << best.sum << std::endl;
 }
 
 int main(int argc, char** argv) {
@@ -106,8 +402,18 @@ int main(int argc, char** argv) {
         
     auto start = high_resolution_clock::now();
     
-    // CODE GOES HERE
-    prime_sequences(1'000'000);
+    // problem050 [n...]; several limits are answered as one batch
+    std::vector<uint64_t> limits;
+    for (int i = 1; i < argc && std::isdigit(static_cast<unsigned char>(argv[i][0])); i++) {
+        limits.push_back(std::stoull(argv[i]));
+    }
+    if (limits.size() <= 1) {
+        prime_sequences(limits.empty() ? 1'000'000 : limits[0]);
+    } else {
+        longest_prime_sums(limits, [&](const size_t i, const PrimeWindow &window) {
+            std::cout << limits[i] << ": length " << window.length << ", sum " << window.sum << std::endl;
+        });
+    }
 
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<std::chrono::microseconds>(stop - start);
@@ -2,9 +2,160 @@
 #include "doctest.h"
 #include "common.h"
 
+#include <cctype>
 #include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
 using namespace std::chrono;
 
+// A prime and the digit positions (low nibble bits, as from bcd_digit_positions) that can be
+// replaced by the same digit to give at least size primes, this one the smallest of them.
+struct Family {
+    uint64_t smallest = 0;
+    uint64_t positions = 0;
+    int size = 0;
+};
+
+// The prime with the replaced digits shown as '*'
+std::string family_pattern(const Family &family) {
+    std::string pattern = std::to_string(family.smallest);
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if ((family.positions >> (4 * i)) & 1) {
+            pattern[pattern.size() - 1 - i] = '*';
+        }
+    }
+    return pattern;
+}
+
+// Whether p is the smallest member of a family of at least k primes. Only digits d <= 10 - k
+// can be the smallest replaced value. For every subset of the positions holding d, the members
+// are p + (v - d) delta, where delta = sum of 10^i over the positions, which is the subset itself
+// read back from BCD. The units digit is never replaced for k >= 5 (at most 1, 3, 7, 9 give primes),
+// and for k >= 8 the count of replaced digits is a multiple of 3, or a third of the values would
+// make the digit sum divisible by 3.
+template <typename IsPrime>
+std::optional<Family> family_from(const uint64_t p, const int length, const int k, IsPrime is_prime) {
+    const uint64_t bcd = to_bcd(p);
+    for (int d = 0; d <= 10 - k; d++) {
+        uint64_t positions = bcd_digit_positions(bcd, length, d);
+        if (k >= 5) {
+            positions &= ~uint64_t{1};
+        }
+        for (uint64_t sub = positions; sub != 0; sub = (sub - 1) & positions) {
+            if (k >= 8 && std::popcount(sub) % 3 != 0) {
+                continue;
+            }
+            const uint64_t delta = from_bcd(sub);
+            const int allowed_misses = (9 - d) - (k - 1);
+            int size = 1;
+            int misses = 0;
+            for (int v = d + 1; v <= 9 && misses <= allowed_misses; v++) {
+                if (is_prime(p + (v - d) * delta)) {
+                    size++;
+                } else {
+                    misses++;
+                }
+            }
+            if (size >= k) {
+                return Family{p, sub, size};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// Primality of every number in [lo, hi), sieved in parallel segments of whole words
+Bitmap bucket_sieve(const uint64_t lo, const uint64_t hi, const std::vector<uint64_t> &base, unsigned threads) {
+    Bitmap bits(hi - lo, false);
+    constexpr uint64_t segment = uint64_t{1} << 20;
+    parallel_for(0, (hi - lo + segment - 1) / segment, [&](uint64_t s_lo, uint64_t s_hi) {
+        for (uint64_t s = s_lo; s < s_hi; s++) {
+            const uint64_t a = lo + s * segment;
+            const Bitmap part = segmented_prime_bitmap(a, std::min(hi, a + segment), base);
+            std::copy(part.words.begin(), part.words.end(), bits.words.begin() + s * segment / 64);
+        }
+    }, threads);
+    return bits;
+}
+
+// Numbers up to this many digits have their primality read off a sieve; longer ones use Miller-Rabin
+constexpr int SIEVE_DIGITS = 9;
+
+// The smallest length-digit prime heading a family of at least k, scanning the primes in order
+std::optional<Family> smallest_family_with_length(const int length, const int k, const std::vector<uint64_t> &base,
+                                                  unsigned threads) {
+    uint64_t lo = 1;
+    for (int i = 1; i < length; i++) {
+        lo *= 10;
+    }
+    const uint64_t hi = 10 * lo;
+
+    const Bitmap sieve = length <= SIEVE_DIGITS ? bucket_sieve(lo, hi, base, threads) : Bitmap();
+    auto is_prime_n = [&](const uint64_t n) { return length <= SIEVE_DIGITS ? sieve.test(n - lo) : is_prime_u64(n); };
+
+    constexpr uint64_t segment = uint64_t{1} << 20;
+    for (uint64_t a = lo; a < hi; a += segment) {
+        const uint64_t b = std::min(hi, a + segment);
+        const Bitmap primes = length <= SIEVE_DIGITS ? Bitmap() : segmented_prime_bitmap(a, b, base);
+        for (uint64_t n = a; n < b; n++) {
+            if (length <= SIEVE_DIGITS ? sieve.test(n - lo) : primes.test(n - a)) {
+                if (auto family = family_from(n, length, k, is_prime_n)) {
+                    return family;
+                }
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// The smallest prime below 10^max_digits heading a family of at least k. Replacing digits keeps
+// the length, so every family lies inside one digit length: the lengths are tried shortest
+// first, each sieved in parallel, and the first one with a family holds the answer. Longer
+// lengths are never sieved.
+std::optional<Family> smallest_prime_family(const int k, const int max_digits = 10, unsigned threads = 0) {
+    assert(max_digits >= 1 && max_digits <= 15);
+    uint64_t top = 1;
+    for (int i = 0; i < max_digits; i++) {
+        top *= 10;
+    }
+    const auto root_sieve = prime_bitmap(static_cast<uint64_t>(std::sqrt(static_cast<double>(top))) + 1);
+    std::vector<uint64_t> base;
+    for (uint64_t i = 2; i < root_sieve.size; i++) {
+        if (root_sieve.test(i)) {
+            base.push_back(i);
+        }
+    }
+
+    for (int length = 1; length <= max_digits; length++) {
+        if (auto family = smallest_family_with_length(length, k, base, threads)) {
+            return family;
+        }
+    }
+    return std::nullopt;
+}
+
+TEST_CASE("prime digit replacement families") {
+    auto is_prime_small = [](const uint64_t n) { return is_prime_u64(n); };
+    CHECK(!family_from(13, 2, 7, is_prime_small).has_value());
+    const auto six = family_from(13, 2, 6, is_prime_small);
+    REQUIRE(six.has_value());
+    CHECK(family_pattern(*six) == "*3");
+    CHECK(six->size == 6);
+
+    const auto seven = family_from(56'003, 5, 7, is_prime_small);
+    REQUIRE(seven.has_value());
+    CHECK(family_pattern(*seven) == "56**3");
+
+    CHECK(smallest_prime_family(6, 6, 1)->smallest == 13);
+    CHECK(smallest_prime_family(7, 6, 3)->smallest == 56'003);
+    const auto eight = smallest_prime_family(8, 6, 2);
+    REQUIRE(eight.has_value());
+    CHECK(eight->smallest == 121'313);
+    CHECK(family_pattern(*eight) == "*2*3*3");
+    CHECK(!smallest_prime_family(8, 5).has_value());
+}
+
 int main(int argc, char** argv) {
 
     doctest::Context ctx;
@@ -13,7 +164,7 @@ int main(int argc, char** argv) {
     // apply command line - argc / argv
     ctx.applyCommandLine(argc, argv);
     // override - don't break in the debugger
-    ctx.setOption("no-breaks", true); 
+    ctx.setOption("no-breaks", true);
     // run test cases unless with --no-run
     int res = ctx.run();
     // query flags (and --exit) rely on this
@@ -21,15 +172,29 @@ int main(int argc, char** argv) {
     // propagate the result of the tests
         return res;
 
-        
+
     auto start = high_resolution_clock::now();
-    
-    // CODE GOES HERE
-    int answer = 0;
+
+    // problem051 [k] [max digits]
+    int k = 8;
+    int max_digits = 10;
+    if (argc >= 2 && std::isdigit(static_cast<unsigned char>(argv[1][0]))) {
+        k = std::stoi(argv[1]);
+    }
+    if (argc >= 3 && std::isdigit(static_cast<unsigned char>(argv[2][0]))) {
+        max_digits = std::stoi(argv[2]);
+    }
+    const auto family = smallest_prime_family(k, max_digits);
+    if (family) {
+        std::cout << "Answer: " << family->smallest << " (family " << family_pattern(*family) << " of "
+                  << family->size << " primes)" << std::endl;
+    } else {
+        std::cout << "No " << k << "-prime family below 10^" << max_digits << std::endl;
+    }
 
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<std::chrono::microseconds>(stop - start);
     std::cout << "Took " << duration.count() << " us" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}